@@ -1,117 +1,449 @@
 #include "gif_algorithm.h"
 
 #include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
 #include <unordered_map>
+#include "gif_cpu.h"
+#include "gif_encoder.h"
+#include "gif_quantize.h"
 
 namespace gif {
 
-namespace {
-void		rgb_to_hsv(const gif::ColorA8u&, double &h, double &s, double &v);
+/**
+ * @class gif::BitmapToPalette
+ */
+void BitmapToPalette::clear() {
+	if (mSampler) mSampler->clear();
+}
+
+void BitmapToPalette::add(const gif::BitmapView &src) {
+	if (!mSampler) mSampler = std::make_shared<PixelSampler>();
+	mSampler->add(src);
+}
+
+void BitmapToPalette::finish(const size_t max_size, gif::Palette &out) {
+	if (mSampler) convert(mSampler->view(), max_size, out);
+	else out.mColors.clear();
 }
 
 /**
- * @class gif::BitmapToPaletteDefault
- * @brief Default implementation, currently simple clamp that finds the most-used colors.
+ * @class gif::BitmapToPaletteMostUsed
+ * @brief Simple clamp that finds the most-used colors.
  */
-class BitmapToPaletteDefault : public BitmapToPalette {
+class BitmapToPaletteMostUsed : public BitmapToPalette {
 public:
-	BitmapToPaletteDefault() { }
+	BitmapToPaletteMostUsed() { }
+
+	void			convert(const gif::BitmapView &src, const size_t max_size, gif::Palette &out) override {
+		mQuantizer.convert(src, max_size, out);
+	}
 
-	void			convert(const gif::Bitmap &src, const size_t max_size, gif::Palette &out) override {
-		out.mColors.clear();
-		if (src.empty()) return;
+	void			clear() override { mQuantizer.clear(); }
+	void			add(const gif::BitmapView &src) override { mQuantizer.add(src); }
+	void			finish(const size_t max_size, gif::Palette &out) override { mQuantizer.finish(max_size, out); }
 
-		// Simple utility to find all colors and eliminate based on a similarity until we're down to our max size.
-		std::unordered_map<gif::ColorA8u, size_t>	ct;
-		for (const auto& pix : src.mPixels) {
-			const gif::ColorA8u		sc = gif::ColorA8u(pix.r, pix.g, pix.b, 255);
-			ct[sc]++;
-		}
+private:
+	MostUsedQuantizer	mQuantizer;
+};
+
+BitmapToPaletteRef BitmapToPalette::createMostUsed() {
+	return std::make_shared<BitmapToPaletteMostUsed>();
+}
+
+/**
+ * @class gif::BitmapToPaletteOctree
+ */
+class BitmapToPaletteOctree : public BitmapToPalette {
+public:
+	BitmapToPaletteOctree(const size_t max_leaves) : mQuantizer(max_leaves) { }
 
-		// For now, just clip based the most-used colors. CLEARLY THIS NEEDS TO CHANGE
-		using Counter = std::pair<gif::ColorA8u, size_t>;
-		std::vector<Counter>						vec;
-		for (const auto& p : ct) vec.push_back(Counter(p.first, p.second));
-		std::sort(vec.begin(), vec.end(), [](const Counter &a, const Counter &b)->bool{return a.second > b.second;});
-		if (vec.size() > max_size) vec.resize(max_size);
-		out.mColors.reserve(max_size);
-		for (const auto& p : vec) out.mColors.push_back(p.first);
+	void			convert(const gif::BitmapView &src, const size_t max_size, gif::Palette &out) override {
+		mQuantizer.convert(src, max_size, out);
 	}
+
+	void			clear() override { mQuantizer.clear(); }
+	void			add(const gif::BitmapView &src) override { mQuantizer.add(src); }
+	void			finish(const size_t max_size, gif::Palette &out) override { mQuantizer.finish(max_size, out); }
+
+private:
+	OctreeQuantizer	mQuantizer;
+};
+
+BitmapToPaletteRef BitmapToPalette::createOctree(const size_t max_leaves) {
+	return std::make_shared<BitmapToPaletteOctree>(max_leaves);
+}
+
+/**
+ * @class gif::BitmapToPaletteWu
+ */
+class BitmapToPaletteWu : public BitmapToPalette {
+public:
+	BitmapToPaletteWu(const size_t threads) { mQuantizer.histogram().setThreads(threads); }
+
+	void			convert(const gif::BitmapView &src, const size_t max_size, gif::Palette &out) override {
+		mQuantizer.convert(src, max_size, out);
+	}
+
+	void			clear() override { mQuantizer.clear(); }
+	void			add(const gif::BitmapView &src) override { mQuantizer.add(src); }
+	void			finish(const size_t max_size, gif::Palette &out) override { mQuantizer.finish(max_size, out); }
+
+private:
+	WuQuantizer		mQuantizer;
 };
 
 BitmapToPaletteRef BitmapToPalette::create() {
-	return std::make_shared<BitmapToPaletteDefault>();
+	return createWu();
+}
+
+BitmapToPaletteRef BitmapToPalette::createWu(const size_t threads) {
+	return std::make_shared<BitmapToPaletteWu>(threads);
+}
+
+/**
+ * @class gif::BitmapToPaletteKMeans
+ */
+class BitmapToPaletteKMeans : public BitmapToPalette {
+public:
+	BitmapToPaletteKMeans(const BitmapToPaletteRef &source, const size_t max_iterations, const size_t max_samples, const size_t threads)
+			: mSource(source), mRefiner(max_iterations, max_samples) { mRefiner.setThreads(threads); }
+
+	void			convert(const gif::BitmapView &src, const size_t max_size, gif::Palette &out) override {
+		mSource->convert(src, max_size, out);
+		mRefiner.refine(src, out);
+	}
+
+	void			clear() override { mSource->clear(); mSampler.clear(); }
+	void			add(const gif::BitmapView &src) override { mSource->add(src); mSampler.add(src); }
+	void			finish(const size_t max_size, gif::Palette &out) override {
+		mSource->finish(max_size, out);
+		mRefiner.refine(mSampler.view(), out);
+	}
+
+private:
+	BitmapToPaletteRef	mSource;
+	KMeansRefiner		mRefiner;
+	PixelSampler		mSampler;
+};
+
+BitmapToPaletteRef BitmapToPalette::createKMeans(	const BitmapToPaletteRef &source, const size_t max_iterations,
+													const size_t max_samples, const size_t threads) {
+	if (!source) throw std::runtime_error("BitmapToPalette::createKMeans() missing source");
+	return std::make_shared<BitmapToPaletteKMeans>(source, max_iterations, max_samples, threads);
+}
+
+/**
+ * @class gif::ToColorIndex
+ */
+void ToColorIndex::matchRow(const gif::ColorA8u *src, uint8_t *dst, const size_t count) const {
+	for (size_t k=0; k<count; ++k) dst[k] = static_cast<uint8_t>(match(src[k]));
 }
 
 /**
  * @class gif::ToColorIndexDefault
  * @brief Given a palette, find the nearest color match to each incoming color.
- * @description Convert an RGB palette to HSV values and find the nearest.
+ * @description A brute force search for the smallest summed RGB distance. The
+ * palette is held as separate channel arrays, so rows are matched by the
+ * vectorised kernel.
  */
 class ToColorIndexDefault : public ToColorIndex {
 public:
 	ToColorIndexDefault() { }
-	ToColorIndexDefault(const double weight_hue, const double weight_saturation, const double weight_value)
-		: mWeightHue(weight_hue), mWeightSat(weight_saturation), mWeightVal(weight_value) { }
 
 	void		setTo(const gif::Palette &pal) override {
-		mColors.clear();
-		for (const auto& c : pal.mColors) {
-			HSV			hsv;
-			rgb_to_hsv(c, hsv.h, hsv.s, hsv.v);
-			mColors.push_back(Lookup(hsv, c));
-		}
+		mMatcher.setTo(pal);
+	}
+
+	size_t		match(const gif::ColorA8u &c) const override {
+		return mMatcher.match(c);
+	}
+
+	void		matchRow(const gif::ColorA8u *src, uint8_t *dst, const size_t count) const override {
+		mMatcher.matchRow(src, dst, count);
+	}
+
+	ToColorIndexRef	clone() const override { return std::make_shared<ToColorIndexDefault>(); }
+
+private:
+	NearestRgbMatcher	mMatcher;
+};
+
+ToColorIndexRef ToColorIndex::create() {
+	return std::make_shared<ToColorIndexDefault>();
+}
+
+/**
+ * @class gif::ToColorIndexLookup
+ * @brief Nearest color match through a lazily filled table of RGB cells.
+ * @description A cell holds 0 until first used, then either a single index
+ * (SINGLE_F set) or the offset + 1 of its candidate list in mCandidates. A
+ * list is the count - 1 followed by the indexes, in palette order.
+ *
+ * A palette entry is a candidate for a cell if its nearest distance to the
+ * cell is no more than the smallest farthest distance of any entry. Whatever
+ * is nearest to a color in the cell must pass that test, so searching just the
+ * candidates (lowest index first) matches the full search exactly.
+ */
+class ToColorIndexLookup : public ToColorIndex {
+public:
+	ToColorIndexLookup(const bool exact) : mExact(exact) { mCells.assign(CELL_COUNT, 0); }
+
+	void		setTo(const gif::Palette &pal) override {
+		mPacked.setTo(pal);
+		mCells.assign(CELL_COUNT, 0);
+		mCandidates.clear();
 	}
 
+	ToColorIndexRef	clone() const override { return std::make_shared<ToColorIndexLookup>(mExact); }
+
 	size_t		match(const gif::ColorA8u &c) const override {
-		// Pulled from
-		// https://social.msdn.microsoft.com/Forums/windows/en-us/105206d5-f7f7-4848-a32e-2b5cc10dc56f/how-to-find-the-nearest-matching-color-?forum=winforms
-		// XXX Although not using that currently, I must have introduced a bug, simple RGB comparison right now.
-
-		double			minDistance = std::numeric_limits<double>::max();
-		size_t			index = 0, ci = 0;
-		double			h, s, v;
-		rgb_to_hsv(c, h, s, v);
-		float			new_d = 255.0f * 4.0f;
-		size_t			new_i = 0;
-		for (const auto& p : mColors) {
-	#if 1
-			const float		dr = fabsf(static_cast<float>(c.r) - static_cast<float>(p.second.r));
-			const float		dg = fabsf(static_cast<float>(c.g) - static_cast<float>(p.second.g));
-			const float		db = fabsf(static_cast<float>(c.b) - static_cast<float>(p.second.b));
-			const float		color_d = (dr + dg + db);
-			if (color_d < new_d) {
-				new_d = color_d;
-				new_i = ci;
+		const uint32_t		cell = lookup(cellOf(c));
+		if ((cell & SINGLE_F) != 0) return cell & 0xff;
+		return refine(c, mCandidates.data() + (cell - 1));
+	}
+
+	void		matchRow(const gif::ColorA8u *src, uint8_t *dst, const size_t count) const override {
+		for (size_t k=0; k<count; ++k) {
+			const uint32_t	cell = lookup(cellOf(src[k]));
+			if ((cell & SINGLE_F) != 0) dst[k] = static_cast<uint8_t>(cell);
+			else dst[k] = static_cast<uint8_t>(refine(src[k], mCandidates.data() + (cell - 1)));
+		}
+	}
+
+private:
+	static const uint32_t	CELL_BITS = 6;
+	static const uint32_t	CELL_SHIFT = 8 - CELL_BITS;
+	static const int32_t	CELL_SIZE = 1 << CELL_SHIFT;
+	static const size_t		CELL_COUNT = size_t(1) << (3 * CELL_BITS);
+	static const uint32_t	SINGLE_F = 0x80000000;
+
+	static size_t			cellOf(const gif::ColorA8u &c) {
+		return	(static_cast<size_t>(c.r >> CELL_SHIFT) << (2 * CELL_BITS)) |
+				(static_cast<size_t>(c.g >> CELL_SHIFT) << CELL_BITS) |
+				static_cast<size_t>(c.b >> CELL_SHIFT);
+	}
+
+	uint32_t				lookup(const size_t index) const {
+		const uint32_t		cell = mCells[index];
+		return cell != 0 ? cell : fill(index);
+	}
+
+	uint32_t				fill(const size_t index) const {
+		const int32_t		lo[3] = {	static_cast<int32_t>((index >> (2 * CELL_BITS)) << CELL_SHIFT),
+										static_cast<int32_t>(((index >> CELL_BITS) & ((1 << CELL_BITS) - 1)) << CELL_SHIFT),
+										static_cast<int32_t>((index & ((1 << CELL_BITS) - 1)) << CELL_SHIFT) };
+		const int16_t*		channels[3] = { mPacked.mR, mPacked.mG, mPacked.mB };
+		uint32_t			cell = SINGLE_F;
+
+		if (mPacked.mSize < 1) {
+			// Nothing to match, everything is index 0
+		} else if (!mExact) {
+			const gif::ColorA8u		center(	static_cast<uint8_t>(lo[0] + CELL_SIZE / 2),
+											static_cast<uint8_t>(lo[1] + CELL_SIZE / 2),
+											static_cast<uint8_t>(lo[2] + CELL_SIZE / 2), 255);
+			cell |= static_cast<uint32_t>(nearest(center));
+		} else {
+			// The smallest farthest distance bounds the candidates
+			int32_t			bound = 0x7fffffff;
+			for (size_t i=0; i<mPacked.mSize; ++i) {
+				int32_t		far_d = 0;
+				for (int c=0; c<3; ++c) {
+					const int32_t	v = channels[c][i];
+					far_d += std::max(std::abs(v - lo[c]), std::abs(v - (lo[c] + CELL_SIZE - 1)));
+				}
+				bound = std::min(bound, far_d);
 			}
-	#else
-			double		dH = p.first.h - h,
-						dS = p.first.s - s,
-						dV = p.first.v - v;
-			double curDistance = std::sqrt(mWeightHue * std::pow(dH, 2) + mWeightSat * std::pow(dS, 2) + mWeightVal * std::pow(dV, 2));
-			if (curDistance < minDistance) {
-				minDistance = curDistance;
-				index = ci;
+			uint8_t			list[256];
+			size_t			list_size = 0;
+			for (size_t i=0; i<mPacked.mSize; ++i) {
+				int32_t		near_d = 0;
+				for (int c=0; c<3; ++c) {
+					const int32_t	v = channels[c][i];
+					near_d += std::max(lo[c] - v, 0) + std::max(v - (lo[c] + CELL_SIZE - 1), 0);
+				}
+				if (near_d <= bound) list[list_size++] = static_cast<uint8_t>(i);
+			}
+			if (list_size == 1) {
+				cell |= list[0];
+			} else {
+				cell = static_cast<uint32_t>(mCandidates.size()) + 1;
+				mCandidates.push_back(static_cast<uint8_t>(list_size - 1));
+				mCandidates.insert(mCandidates.end(), list, list + list_size);
+			}
+		}
+		mCells[index] = cell;
+		return cell;
+	}
+
+	size_t					nearest(const gif::ColorA8u &c) const {
+		uint8_t				index = 0;
+		gif::kernels().mMatchRow(&c, 1, mPacked, &index);
+		return index;
+	}
+
+	size_t					refine(const gif::ColorA8u &c, const uint8_t *list) const {
+		const size_t		count = static_cast<size_t>(list[0]) + 1;
+		const int32_t		r = c.r, g = c.g, b = c.b;
+		int32_t				best_d = 0x7fffffff;
+		size_t				best_i = 0;
+		for (size_t k=1; k<=count; ++k) {
+			const size_t	i = list[k];
+			const int32_t	d = std::abs(r - mPacked.mR[i]) + std::abs(g - mPacked.mG[i]) + std::abs(b - mPacked.mB[i]);
+			if (d < best_d) {
+				best_d = d;
+				best_i = i;
+			}
+		}
+		return best_i;
+	}
+
+	const bool				mExact;
+	gif::PackedPalette		mPacked;
+	mutable gif::Vector<uint32_t>
+							mCells;
+	mutable gif::Vector<uint8_t>
+							mCandidates;
+};
+
+ToColorIndexRef ToColorIndex::createLookup(const bool exact) {
+	return std::make_shared<ToColorIndexLookup>(exact);
+}
+
+/**
+ * @class gif::ToColorIndexMemo
+ * @brief Cache the matches of another ToColorIndex.
+ * @description An open addressed table of color to index. Slots pack the
+ * color, the index and an in-use flag. The table doubles at half full up to
+ * MAX_SLOTS, and past that starts over, so noisy input can't grow it forever.
+ */
+class ToColorIndexMemo : public ToColorIndex {
+public:
+	ToColorIndexMemo(const ToColorIndexRef &source) : mSource(source) { }
+
+	ToColorIndexRef	clone() const override {
+		ToColorIndexRef		source = mSource->clone();
+		if (!source) return nullptr;
+		return std::make_shared<ToColorIndexMemo>(source);
+	}
+
+	void		setTo(const gif::Palette &pal) override {
+		if (mHasPalette && pal.mColors == mPalette.mColors) return;
+		mSource->setTo(pal);
+		mPalette.mColors = pal.mColors;
+		mHasPalette = true;
+		reset(MIN_SLOTS);
+	}
+
+	size_t		match(const gif::ColorA8u &c) const override {
+		uint8_t				index;
+		if (find(c, index)) return index;
+		index = static_cast<uint8_t>(mSource->match(c));
+		insert(c, index);
+		return index;
+	}
+
+	void		matchRow(const gif::ColorA8u *src, uint8_t *dst, const size_t count) const override {
+		// Hits are answered in place, misses are gathered and sent to the source as one row.
+		mMissAt.clear();
+		mMissColors.clear();
+		for (size_t k=0; k<count; ++k) {
+			if (!find(src[k], dst[k])) {
+				mMissAt.push_back(k);
+				mMissColors.push_back(src[k]);
 			}
-	#endif
-			++ci;
 		}
-	//	return index;
-		return new_i;
+		if (mMissAt.empty()) return;
+
+		mMissIndexes.resize(mMissAt.size());
+		mSource->matchRow(mMissColors.data(), mMissIndexes.data(), mMissColors.size());
+		for (size_t k=0; k<mMissAt.size(); ++k) {
+			dst[mMissAt[k]] = mMissIndexes[k];
+			insert(mMissColors[k], mMissIndexes[k]);
+		}
 	}
 
 private:
-	struct HSV { double h = 0.0; double s = 0.0; double v = 0.0;};
-	using Lookup = std::pair<HSV, gif::ColorA8u>;
-	std::vector<Lookup>	mColors;
+	static const size_t		MIN_SLOTS = 1<<12;
+	static const size_t		MAX_SLOTS = 1<<20;
+	static const uint64_t	USED_F = uint64_t(1) << 40;
+
+	static uint32_t			keyOf(const gif::ColorA8u &c) {
+		return	(static_cast<uint32_t>(c.r) << 24) | (static_cast<uint32_t>(c.g) << 16) |
+				(static_cast<uint32_t>(c.b) << 8) | static_cast<uint32_t>(c.a);
+	}
+	size_t					slotOf(const uint32_t key) const {
+		return static_cast<size_t>((key * 0x9E3779B1u) >> mShift);
+	}
+
+	bool					find(const gif::ColorA8u &c, uint8_t &index) const {
+		const uint32_t		key = keyOf(c);
+		const size_t		mask = mSlots.size() - 1;
+		for (size_t s=slotOf(key); ; s=(s+1) & mask) {
+			const uint64_t	slot = mSlots[s];
+			if (slot == 0) return false;
+			if (static_cast<uint32_t>(slot >> 8) == key) {
+				index = static_cast<uint8_t>(slot);
+				return true;
+			}
+		}
+	}
+
+	void					insert(const gif::ColorA8u &c, const uint8_t index) const {
+		if ((mUsed + 1) * 2 > mSlots.size()) {
+			reset(mSlots.size() < MAX_SLOTS ? mSlots.size() * 2 : MAX_SLOTS);
+		}
+		const uint32_t		key = keyOf(c);
+		const size_t		mask = mSlots.size() - 1;
+		size_t				s = slotOf(key);
+		while (mSlots[s] != 0) {
+			// Already there from a duplicate miss in the same row
+			if (static_cast<uint32_t>(mSlots[s] >> 8) == key) return;
+			s = (s+1) & mask;
+		}
+		mSlots[s] = USED_F | (static_cast<uint64_t>(key) << 8) | index;
+		++mUsed;
+	}
+
+	// Resize to slot_count, keeping what's there unless it's shrinking or staying
+	// at MAX_SLOTS, in which case start over.
+	void					reset(const size_t slot_count) const {
+		gif::Vector<uint64_t>	old(mSlots.get_allocator());
+		if (slot_count > mSlots.size()) old.swap(mSlots);
+		mSlots.assign(slot_count, 0);
+		mUsed = 0;
+		mShift = 32;
+		for (size_t n=slot_count; n>1; n>>=1) --mShift;
+		for (const auto& slot : old) {
+			if (slot == 0) continue;
+			const uint32_t	key = static_cast<uint32_t>(slot >> 8);
+			size_t			s = slotOf(key);
+			while (mSlots[s] != 0) s = (s+1) & (slot_count - 1);
+			mSlots[s] = slot;
+			++mUsed;
+		}
+	}
 
-	double				mWeightHue = 0.8,
-						mWeightSat = 0.1,
-						mWeightVal = 0.1;
+	ToColorIndexRef			mSource;
+	gif::Palette			mPalette;
+	bool					mHasPalette = false;
+
+	mutable gif::Vector<uint64_t>
+							mSlots = gif::Vector<uint64_t>(MIN_SLOTS, 0);
+	mutable size_t			mUsed = 0;
+	mutable uint32_t		mShift = 20;
+	// Scratch for matchRow()
+	mutable gif::Vector<size_t>
+							mMissAt;
+	mutable gif::Vector<gif::ColorA8u>
+							mMissColors;
+	mutable gif::Vector<uint8_t>
+							mMissIndexes;
 };
 
-ToColorIndexRef ToColorIndex::create() {
-	return std::make_shared<ToColorIndexDefault>();
+ToColorIndexRef ToColorIndex::createMemo(const ToColorIndexRef &source) {
+	if (!source) throw std::runtime_error("ToColorIndex::createMemo() missing source");
+	return std::make_shared<ToColorIndexMemo>(source);
 }
 
 /**
@@ -121,61 +453,25 @@ class ToPalettedBitmapDefault : public ToPalettedBitmap {
 public:
 	ToPalettedBitmapDefault() { }
 
-	bool		convert(const gif::Bitmap &bm, const gif::ToColorIndexRef &tci, gif::PalettedBitmap &pbm) override {
+	bool		convert(const gif::BitmapView &bm, const gif::ToColorIndexRef &tci, gif::PalettedBitmap &pbm) override {
 		pbm.clear();
 		if (bm.empty() || !tci) return false;
 		pbm.setTo(bm.mWidth, bm.mHeight);
-		if (bm.mPixels.size() != pbm.mPixels.size()) return false;
+		if (pbm.empty()) return false;
 
-		auto		dst = pbm.mPixels.begin();
-		for (const auto& c : bm.mPixels) {
-			*dst = tci->match(c);
-			++dst;
+		const size_t	w = static_cast<size_t>(bm.mWidth);
+		for (int32_t y=0; y<bm.mHeight; ++y) {
+			tci->matchRow(bm.row(y), pbm.mPixels.data() + static_cast<size_t>(y) * w, w);
 		}
 
 		return true;
 	}
+
+	ToPalettedBitmapRef	clone() const override { return std::make_shared<ToPalettedBitmapDefault>(); }
 };
 
 ToPalettedBitmapRef ToPalettedBitmap::create() {
 	return std::make_shared<ToPalettedBitmapDefault>();
 }
 
-namespace {
-
-// Results in HSV of H=[0,360], S=[0,1], V=[0,1]
-// if S == 0 then H = -1 (undefined)
-void		rgb_to_hsv(const gif::ColorA8u &c, double &_h, double &_s, double &_v) {
-	const double			r = static_cast<double>(c.r) / 255.0,
-							g = static_cast<double>(c.g) / 255.0,
-							b = static_cast<double>(c.b) / 255.0;
-	const double			max = std::max<double>(r, std::max<double>(g, b));
-	const double			min = std::min<double>(r, std::min<double>(g, b));
-	const double			delta = max-min;
-	_v = max;
-
-	// gray
-	if (min == max) {
-		_h = -1.0;
-		_s = 0.0;
-		return;
-	}
-
-	if (max != 0.0) {
-		_s = delta / max;
-	} else {
-		_s = 0.0;
-		_h = -1;
-		return;
-	}
-
-	if (r == max)			_h = (g-b) / delta;
-	else if (g == max)		_h = 2 + (b-r) / delta;
-	else					_h = 4 + (r-g) / delta;
-	_h *= 60.0;
-	if (_h < 0.0)			_h += 360;				
-}
-
-}
-
 } // namespace gif
@@ -18,6 +18,7 @@ class ToColorIndex;
 using ToColorIndexRef = std::shared_ptr<ToColorIndex>;
 class ToPalettedBitmap;
 using ToPalettedBitmapRef = std::shared_ptr<ToPalettedBitmap>;
+class PixelSampler;
 
 /**
  * @class gif::BitmapToPalette
@@ -30,10 +31,32 @@ public:
 	virtual ~BitmapToPalette() { }
 
 	// @param max_size is the maximum allowed size of the final palette.
-	virtual void				convert(const gif::Bitmap&, const size_t max_size, gif::Palette&) = 0;
+	virtual void				convert(const gif::BitmapView&, const size_t max_size, gif::Palette&) = 0;
+
+	// Build one palette from many bitmaps: clear(), add() each, then finish().
+	// By default the bitmaps are sampled and the sample is handed to convert().
+	virtual void				clear();
+	virtual void				add(const gif::BitmapView&);
+	virtual void				finish(const size_t max_size, gif::Palette&);
 
 	// Implementations
+	// The default, currently createWu().
 	static BitmapToPaletteRef	create();
+	// Keep the most used colors. Fast, but poor on photographic frames.
+	static BitmapToPaletteRef	createMostUsed();
+	// An octree that merges similar colors, better than create() on photographic
+	// frames. max_leaves bounds the colors held while counting.
+	static BitmapToPaletteRef	createOctree(const size_t max_leaves = 4096);
+	// Wu's variance minimising quantizer, near median cut quality in about the time
+	// of counting the pixels. Rows are counted on threads (0 for none).
+	static BitmapToPaletteRef	createWu(const size_t threads = 0);
+	// Refine the palette from source with up to max_iterations of k-means over a
+	// sample of max_samples pixels, on threads (0 for none). Slower, better colors.
+	static BitmapToPaletteRef	createKMeans(	const BitmapToPaletteRef &source, const size_t max_iterations = 4,
+												const size_t max_samples = 1<<16, const size_t threads = 0);
+
+private:
+	std::shared_ptr<PixelSampler>	mSampler;
 };
 
 /**
@@ -48,9 +71,26 @@ public:
 
 	virtual void				setTo(const gif::Palette&) = 0;
 	virtual size_t				match(const gif::ColorA8u&) const = 0;
+	// Match count colors from src into dst. The default calls match() on each;
+	// override it to amortise work across a row.
+	virtual void				matchRow(const gif::ColorA8u *src, uint8_t *dst, const size_t count) const;
+	// Answer a new instance with the same settings and no palette, for use on another
+	// thread. The default answers nullptr, which means I can't be used by an encoder
+	// with encode threads.
+	virtual ToColorIndexRef		clone() const { return nullptr; }
 
 	// Implementations
 	static ToColorIndexRef		create();
+	// Answer from a table of RGB cells (6 bits a channel) that's filled in as colors
+	// arrive, so a repeated color costs one lookup. If exact, each cell keeps the palette
+	// entries that could be nearest to anything in it and picks among those, giving the
+	// same answers as create(); otherwise the whole cell maps to the entry nearest its
+	// center. Not thread safe, even for matching.
+	static ToColorIndexRef		createLookup(const bool exact = true);
+	// Remember the answer for each color source gives, for as long as the palette
+	// stays the same. setTo() with an unchanged palette keeps the memo and doesn't
+	// reach source at all. Not thread safe, even for matching.
+	static ToColorIndexRef		createMemo(const ToColorIndexRef &source);
 };
 
 /**
@@ -63,7 +103,11 @@ protected:
 public:
 	virtual ~ToPalettedBitmap() { }
 
-	virtual bool				convert(const gif::Bitmap&, const gif::ToColorIndexRef&, gif::PalettedBitmap &pbm) = 0;
+	// The output is always packed, whatever the stride of the source.
+	virtual bool				convert(const gif::BitmapView&, const gif::ToColorIndexRef&, gif::PalettedBitmap &pbm) = 0;
+	// Answer a new instance with the same settings, for use on another thread. The
+	// default answers nullptr, which means I can't be used by an encoder with encode threads.
+	virtual ToPalettedBitmapRef	clone() const { return nullptr; }
 
 	// Implementations
 	static ToPalettedBitmapRef	create();
@@ -1,11 +1,119 @@
 #ifndef GIFWRAP_GIFBITMAP_H_
 #define GIFWRAP_GIFBITMAP_H_
 
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include "gif_color.h"
 
 namespace gif {
 
+/**
+ * @class gif::Rect
+ * @brief An integer area. Right and bottom are exclusive.
+ */
+class Rect {
+public:
+	Rect() { }
+	Rect(const int32_t l, const int32_t t, const int32_t r, const int32_t b) : mLeft(l), mTop(t), mRight(r), mBottom(b) { }
+
+	static Rect					fromSize(const int32_t l, const int32_t t, const int32_t w, const int32_t h) { return Rect(l, t, l+w, t+h); }
+
+	bool						empty() const { return mRight <= mLeft || mBottom <= mTop; }
+	int32_t						width() const { return mRight - mLeft; }
+	int32_t						height() const { return mBottom - mTop; }
+	bool						contains(const int32_t x, const int32_t y) const { return x >= mLeft && x < mRight && y >= mTop && y < mBottom; }
+
+	// Answer the overlapping area, which will be empty if there is none.
+	Rect						intersect(const Rect &r) const {
+		Rect					ans(std::max(mLeft, r.mLeft), std::max(mTop, r.mTop), std::min(mRight, r.mRight), std::min(mBottom, r.mBottom));
+		if (ans.empty()) return Rect();
+		return ans;
+	}
+
+	int32_t						mLeft = 0,
+								mTop = 0,
+								mRight = 0,
+								mBottom = 0;
+};
+
+class Bitmap;
+class AlignedBitmap;
+class PalettedBitmap;
+class AlignedPalettedBitmap;
+
+/**
+ * @class gif::BitmapView
+ * @brief A read-only window onto RGBA pixels owned by someone else.
+ * @description mStride is the distance between row starts in pixels, so a
+ * view can describe part of a larger image or a foreign buffer with padded
+ * rows. The view is only valid as long as the pixels it points to.
+ */
+class BitmapView {
+public:
+	BitmapView() { }
+	BitmapView(const gif::ColorA8u *pixels, const int32_t w, const int32_t h, const size_t stride)
+			: mPixels(pixels), mWidth(w), mHeight(h), mStride(stride) { }
+	BitmapView(const gif::Bitmap&);
+	BitmapView(const gif::AlignedBitmap&);
+
+	bool						empty() const { return mWidth < 1 || mHeight < 1 || !mPixels; }
+	// True when the rows are packed, i.e. the pixels are one run of mWidth * mHeight.
+	bool						isContiguous() const { return mStride == static_cast<size_t>(mWidth); }
+	const gif::ColorA8u*		row(const int32_t y) const { return mPixels + static_cast<size_t>(y) * mStride; }
+
+	// Answer a view of the area, clipped to me.
+	BitmapView					sub(const gif::Rect &r) const {
+		const gif::Rect			a = r.intersect(gif::Rect(0, 0, mWidth, mHeight));
+		if (a.empty()) return BitmapView();
+		return BitmapView(row(a.mTop) + a.mLeft, a.width(), a.height(), mStride);
+	}
+
+	// Same size and pixels, regardless of stride.
+	bool						operator==(const BitmapView &o) const {
+		if (mWidth != o.mWidth || mHeight != o.mHeight) return false;
+		for (int32_t y=0; y<mHeight; ++y) {
+			if (!std::equal(row(y), row(y) + mWidth, o.row(y))) return false;
+		}
+		return true;
+	}
+	bool						operator!=(const BitmapView &o) const { return !(*this == o); }
+
+	const gif::ColorA8u*		mPixels = nullptr;
+	int32_t						mWidth = 0,
+								mHeight = 0;
+	size_t						mStride = 0;
+};
+
+/**
+ * @class gif::PalettedBitmapView
+ * @brief A read-only window onto palette codes owned by someone else.
+ * mStride is the distance between row starts in bytes.
+ */
+class PalettedBitmapView {
+public:
+	PalettedBitmapView() { }
+	PalettedBitmapView(const uint8_t *pixels, const int32_t w, const int32_t h, const size_t stride)
+			: mPixels(pixels), mWidth(w), mHeight(h), mStride(stride) { }
+	PalettedBitmapView(const gif::PalettedBitmap&);
+	PalettedBitmapView(const gif::AlignedPalettedBitmap&);
+
+	bool						empty() const { return mWidth < 1 || mHeight < 1 || !mPixels; }
+	bool						isContiguous() const { return mStride == static_cast<size_t>(mWidth); }
+	const uint8_t*				row(const int32_t y) const { return mPixels + static_cast<size_t>(y) * mStride; }
+
+	PalettedBitmapView			sub(const gif::Rect &r) const {
+		const gif::Rect			a = r.intersect(gif::Rect(0, 0, mWidth, mHeight));
+		if (a.empty()) return PalettedBitmapView();
+		return PalettedBitmapView(row(a.mTop) + a.mLeft, a.width(), a.height(), mStride);
+	}
+
+	const uint8_t*				mPixels = nullptr;
+	int32_t						mWidth = 0,
+								mHeight = 0;
+	size_t						mStride = 0;
+};
+
 /**
  * @class gif::Bitmap
  * @brief A local bitmap definition, an array of colours.
@@ -13,7 +121,8 @@ namespace gif {
 class Bitmap {
 public:
 	Bitmap() { }
-	Bitmap(const int32_t w, const int32_t h) { setTo(w, h); }
+	explicit Bitmap(gif::MemoryResource *r) : mPixels(gif::Allocator<gif::ColorA8u>(r)) { }
+	Bitmap(const int32_t w, const int32_t h, gif::MemoryResource *r = nullptr) : mPixels(gif::Allocator<gif::ColorA8u>(r)) { setTo(w, h); }
 
 	bool						empty() const { return mWidth < 1 || mHeight < 1; }
 	void						setTo(const int32_t w, const int32_t h) {
@@ -23,10 +132,21 @@ public:
 		mPixels.clear();
 		if (w > 0 && h > 0) mPixels.resize(w * h);
 	}
+	// Resize to the view and copy its pixels, packing the rows.
+	void						copyFrom(const gif::BitmapView &v) {
+		if (v.empty()) {
+			setTo(0, 0);
+			return;
+		}
+		setTo(v.mWidth, v.mHeight);
+		for (int32_t y=0; y<v.mHeight; ++y) {
+			std::copy(v.row(y), v.row(y) + v.mWidth, mPixels.begin() + static_cast<size_t>(y) * static_cast<size_t>(mWidth));
+		}
+	}
 
 	int32_t						mWidth = 0,
 								mHeight = 0;
-	std::vector<gif::ColorA8u>	mPixels;
+	gif::Vector<gif::ColorA8u>	mPixels;
 };
 
 /**
@@ -36,7 +156,8 @@ public:
 class PalettedBitmap {
 public:
 	PalettedBitmap() { }
-	PalettedBitmap(const int32_t w, const int32_t h) { setTo(w, h); }
+	explicit PalettedBitmap(gif::MemoryResource *r) : mPixels(gif::Allocator<uint8_t>(r)) { }
+	PalettedBitmap(const int32_t w, const int32_t h, gif::MemoryResource *r = nullptr) : mPixels(gif::Allocator<uint8_t>(r)) { setTo(w, h); }
 
 	bool						empty() const { return mWidth < 1 || mHeight < 1; }
 
@@ -55,9 +176,129 @@ public:
 
 	int32_t						mWidth = 0,
 								mHeight = 0;
-	std::vector<uint8_t>		mPixels;
+	gif::Vector<uint8_t>		mPixels;
+};
+
+/**
+ * @class gif::AlignedBitmap
+ * @brief An RGBA bitmap whose rows each start on a ROW_ALIGN byte boundary.
+ * @description Rows are padded out to the alignment, so vector kernels can
+ * use aligned loads on every row and run over the padding without a scalar
+ * tail. Access pixels through row() or a BitmapView; the padding is not part
+ * of the image. Not copyable, since a copy would need to be realigned.
+ */
+class AlignedBitmap {
+public:
+	static const size_t			ROW_ALIGN = 64;
+
+	AlignedBitmap() { }
+	AlignedBitmap(const AlignedBitmap&) = delete;
+	explicit AlignedBitmap(gif::MemoryResource *r) : mStorage(gif::Allocator<uint8_t>(r)) { }
+	AlignedBitmap(const int32_t w, const int32_t h, gif::MemoryResource *r = nullptr) : mStorage(gif::Allocator<uint8_t>(r)) { setTo(w, h); }
+
+	AlignedBitmap&				operator=(const AlignedBitmap&) = delete;
+
+	bool						empty() const { return mWidth < 1 || mHeight < 1; }
+	// Resize, with every pixel (including the padding) set to transparent black.
+	// Does nothing if the size is unchanged.
+	void						setTo(const int32_t w, const int32_t h) {
+		if (w == mWidth && h == mHeight) return;
+		const size_t			align_pixels = ROW_ALIGN / sizeof(gif::ColorA8u);
+		mWidth = std::max<int32_t>(w, 0);
+		mHeight = std::max<int32_t>(h, 0);
+		mStride = ((static_cast<size_t>(mWidth) + align_pixels - 1) / align_pixels) * align_pixels;
+		mStorage.clear();
+		mOffset = 0;
+		if (empty()) return;
+		// Stored as bytes and over-allocated, so the first row can be shifted onto
+		// the boundary whatever the resource's alignment.
+		mStorage.resize(mStride * static_cast<size_t>(mHeight) * sizeof(gif::ColorA8u) + ROW_ALIGN);
+		const uintptr_t			addr = reinterpret_cast<uintptr_t>(mStorage.data());
+		mOffset = (ROW_ALIGN - (addr % ROW_ALIGN)) % ROW_ALIGN;
+	}
+	void						fill(const gif::ColorA8u &c) {
+		if (empty()) return;
+		std::fill(row(0), row(0) + mStride * static_cast<size_t>(mHeight), c);
+	}
+	void						copyFrom(const gif::BitmapView &v) {
+		setTo(v.empty() ? 0 : v.mWidth, v.empty() ? 0 : v.mHeight);
+		for (int32_t y=0; y<mHeight; ++y) std::copy(v.row(y), v.row(y) + v.mWidth, row(y));
+	}
+
+	gif::ColorA8u*				row(const int32_t y) { return reinterpret_cast<gif::ColorA8u*>(mStorage.data() + mOffset) + static_cast<size_t>(y) * mStride; }
+	const gif::ColorA8u*		row(const int32_t y) const { return reinterpret_cast<const gif::ColorA8u*>(mStorage.data() + mOffset) + static_cast<size_t>(y) * mStride; }
+
+	int32_t						mWidth = 0,
+								mHeight = 0;
+	// Pixels between row starts
+	size_t						mStride = 0;
+
+private:
+	gif::Vector<uint8_t>		mStorage;
+	// Bytes from the start of storage to the first row
+	size_t						mOffset = 0;
 };
 
+/**
+ * @class gif::AlignedPalettedBitmap
+ * @brief Palette codes with each row starting on a ROW_ALIGN byte boundary.
+ */
+class AlignedPalettedBitmap {
+public:
+	static const size_t			ROW_ALIGN = 64;
+
+	AlignedPalettedBitmap() { }
+	AlignedPalettedBitmap(const AlignedPalettedBitmap&) = delete;
+	explicit AlignedPalettedBitmap(gif::MemoryResource *r) : mStorage(gif::Allocator<uint8_t>(r)) { }
+	AlignedPalettedBitmap(const int32_t w, const int32_t h, gif::MemoryResource *r = nullptr) : mStorage(gif::Allocator<uint8_t>(r)) { setTo(w, h); }
+
+	AlignedPalettedBitmap&		operator=(const AlignedPalettedBitmap&) = delete;
+
+	bool						empty() const { return mWidth < 1 || mHeight < 1; }
+	void						setTo(const int32_t w, const int32_t h) {
+		if (w == mWidth && h == mHeight) return;
+		mWidth = std::max<int32_t>(w, 0);
+		mHeight = std::max<int32_t>(h, 0);
+		mStride = ((static_cast<size_t>(mWidth) + ROW_ALIGN - 1) / ROW_ALIGN) * ROW_ALIGN;
+		mStorage.clear();
+		mOffset = 0;
+		if (empty()) return;
+		mStorage.resize(mStride * static_cast<size_t>(mHeight) + ROW_ALIGN);
+		const uintptr_t			addr = reinterpret_cast<uintptr_t>(mStorage.data());
+		mOffset = (ROW_ALIGN - (addr % ROW_ALIGN)) % ROW_ALIGN;
+	}
+
+	uint8_t*					row(const int32_t y) { return mStorage.data() + mOffset + static_cast<size_t>(y) * mStride; }
+	const uint8_t*				row(const int32_t y) const { return mStorage.data() + mOffset + static_cast<size_t>(y) * mStride; }
+
+	int32_t						mWidth = 0,
+								mHeight = 0;
+	size_t						mStride = 0;
+
+private:
+	gif::Vector<uint8_t>		mStorage;
+	size_t						mOffset = 0;
+};
+
+/**
+ * gif::BitmapView and gif::PalettedBitmapView IMPLEMENTATION
+ */
+inline BitmapView::BitmapView(const gif::Bitmap &bm)
+		: mPixels(bm.mPixels.empty() ? nullptr : bm.mPixels.data()), mWidth(bm.mWidth), mHeight(bm.mHeight), mStride(static_cast<size_t>(std::max<int32_t>(bm.mWidth, 0))) {
+}
+
+inline BitmapView::BitmapView(const gif::AlignedBitmap &bm)
+		: mPixels(bm.empty() ? nullptr : bm.row(0)), mWidth(bm.mWidth), mHeight(bm.mHeight), mStride(bm.mStride) {
+}
+
+inline PalettedBitmapView::PalettedBitmapView(const gif::PalettedBitmap &bm)
+		: mPixels(bm.mPixels.empty() ? nullptr : bm.mPixels.data()), mWidth(bm.mWidth), mHeight(bm.mHeight), mStride(static_cast<size_t>(std::max<int32_t>(bm.mWidth, 0))) {
+}
+
+inline PalettedBitmapView::PalettedBitmapView(const gif::AlignedPalettedBitmap &bm)
+		: mPixels(bm.empty() ? nullptr : bm.row(0)), mWidth(bm.mWidth), mHeight(bm.mHeight), mStride(bm.mStride) {
+}
+
 } // namespace gif
 
 #endif
@@ -1,11 +1,16 @@
 #include "gif_block.h"
 
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <stdexcept>
+
 namespace gif {
 
 /**
  * @class gif::Block
  */
-size_t Block::readSubBlocks(const std::vector<char> &buffer, size_t position) {
+size_t Block::readSubBlocks(const gif::Vector<char> &buffer, size_t position) {
 	// Read data blocks, first byte is block size, 0 is the terminator
 	uint8_t				block_size = 0;
 	while ( (block_size = buffer[position++]) != 0) {
@@ -22,7 +27,7 @@ size_t Block::readSubBlocks(const std::vector<char> &buffer, size_t position) {
 /**
  * @class gif::GraphicControlExtension
  */
-size_t GraphicControlExtension::read(const std::vector<char> &buffer, size_t position) {
+size_t GraphicControlExtension::read(const gif::Vector<char> &buffer, size_t position) {
 	// We are past the introducer and GCE bytes here
 	uint8_t				block_size = buffer[position++];
 	if (block_size != 4) throw std::runtime_error("GraphicControlExtension has illegal Block Size");
@@ -54,4 +59,29 @@ size_t GraphicControlExtension::read(const std::vector<char> &buffer, size_t pos
 	return position;
 }
 
+void GraphicControlExtension::write(std::ostream &output) const {
+	// Extension introducer, GCE label and block size
+	output << static_cast<uint8_t>(0x21) << static_cast<uint8_t>(0xf9) << static_cast<uint8_t>(4);
+
+	// fields
+	uint8_t				fields = 0;
+	if ((mFlags&TRANSPARENT_COLOR_F) != 0) fields |= (1<<0);
+	if ((mFlags&USER_INPUT_EXPECTED_F) != 0) fields |= (1<<1);
+	if (mDisposal == Disposal::kDoNotDispose) fields |= (1<<2);
+	else if (mDisposal == Disposal::kRestoreToBackgroundColor) fields |= (2<<2);
+	else if (mDisposal == Disposal::kRestoreToPrevious) fields |= (3<<2);
+	output << fields;
+
+	// delay time, in hundredths of a second
+	const double		hundredths = std::floor(mDelay * 100.0 + 0.5);
+	const uint16_t		v = static_cast<uint16_t>(std::max(0.0, std::min(hundredths, 65535.0)));
+	output << static_cast<uint8_t>(v&0xff) << static_cast<uint8_t>((v>>8)&0xff);
+
+	// transparent color index
+	output << mTransparencyIndex;
+
+	// terminator
+	output << static_cast<uint8_t>(0);
+}
+
 } // namespace gif
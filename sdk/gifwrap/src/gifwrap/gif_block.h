@@ -1,9 +1,10 @@
 #ifndef GIFWRAP_GIFBLOCK_H_
 #define GIFWRAP_GIFBLOCK_H_
 
+#include <iosfwd>
 #include <memory>
 #include <string>
-#include <vector>
+#include "gif_memory.h"
 
 namespace gif {
 class Block;
@@ -21,7 +22,7 @@ class Data {
 public:
 	Data() { }
 
-	std::vector<char>	mData;
+	gif::Vector<char>	mData;
 };
 
 /**
@@ -34,9 +35,9 @@ public:
 	virtual ~Block() { }
 
 	// Generic utility to read blocks
-	size_t					readSubBlocks(const std::vector<char> &buffer, size_t position);
+	size_t					readSubBlocks(const gif::Vector<char> &buffer, size_t position);
 
-	std::vector<DataRef>	mSubBlocks;
+	gif::Vector<DataRef>	mSubBlocks;
 };
 
 /**
@@ -53,7 +54,9 @@ public:
 
 	bool					hasTransparentColor() const { return (mFlags&TRANSPARENT_COLOR_F) != 0; }
 
-	size_t					read(const std::vector<char> &buffer, size_t position);
+	size_t					read(const gif::Vector<char> &buffer, size_t position);
+	// Write the whole extension, including the introducer and label.
+	void					write(std::ostream&) const;
 
 	uint32_t				mFlags = 0;
 	Disposal				mDisposal = Disposal::kUnspecified;
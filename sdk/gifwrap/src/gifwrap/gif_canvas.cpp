@@ -0,0 +1,115 @@
+#include "gif_canvas.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace gif {
+
+/**
+ * @class gif::TiledCanvas
+ */
+TiledCanvas::TiledCanvas(const int32_t width, const int32_t height, const int32_t tile_size)
+		: mWidth(std::max<int32_t>(width, 0))
+		, mHeight(std::max<int32_t>(height, 0))
+		, mTileSize(std::max<int32_t>(tile_size, 16))
+		, mTilesAcross((mWidth + mTileSize - 1) / mTileSize)
+		, mTilesDown((mHeight + mTileSize - 1) / mTileSize) {
+	mTiles.resize(static_cast<size_t>(mTilesAcross) * static_cast<size_t>(mTilesDown));
+}
+
+TiledCanvas::~TiledCanvas() {
+	if (mSpill.is_open()) {
+		mSpill.close();
+		std::remove(mSpillPath.c_str());
+	}
+}
+
+void TiledCanvas::setSpill(const std::string &path, const size_t max_resident) {
+	if (mSpill.is_open()) {
+		mSpill.close();
+		std::remove(mSpillPath.c_str());
+	}
+	mMaxResident = 0;
+	mSpillPath = path;
+	if (path.empty()) return;
+
+	mSpill.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!mSpill.is_open()) throw std::runtime_error("TiledCanvas can't open spill file " + path);
+	mMaxResident = std::max<size_t>(max_resident, static_cast<size_t>(mTilesAcross) + 1);
+}
+
+gif::ColorA8u* TiledCanvas::row(const int32_t x, const int32_t y, int32_t &count) {
+	const int32_t			tx = x / mTileSize,
+							ty = y / mTileSize;
+	const int32_t			lx = x - (tx * mTileSize),
+							ly = y - (ty * mTileSize);
+	// Tiles on the right edge are allocated at full size, but only the part on the canvas is valid.
+	count = std::min(mTileSize, mWidth - (tx * mTileSize)) - lx;
+	gif::ColorA8u*			pixels = touch(static_cast<size_t>(ty) * static_cast<size_t>(mTilesAcross) + static_cast<size_t>(tx));
+	return pixels + (static_cast<size_t>(ly) * static_cast<size_t>(mTileSize)) + static_cast<size_t>(lx);
+}
+
+void TiledCanvas::readBand(const int32_t top, const int32_t height, gif::Bitmap &band) {
+	const int32_t			h = std::max<int32_t>(std::min(height, mHeight - top), 0);
+	band.setTo(mWidth, h);
+	if (band.empty()) return;
+
+	for (int32_t y=0; y<h; ++y) {
+		const int32_t		cy = top + y,
+							ty = cy / mTileSize,
+							ly = cy - (ty * mTileSize);
+		gif::ColorA8u*		dst = band.mPixels.data() + (static_cast<size_t>(y) * static_cast<size_t>(mWidth));
+		for (int32_t tx=0; tx<mTilesAcross; ++tx) {
+			const int32_t	count = std::min(mTileSize, mWidth - (tx * mTileSize));
+			const Tile&		tile = mTiles[static_cast<size_t>(ty) * static_cast<size_t>(mTilesAcross) + static_cast<size_t>(tx)];
+			if (tile.mPixels.empty() && !tile.mSpilled) {
+				// Never touched
+				std::fill(dst, dst + count, gif::ColorA8u());
+			} else {
+				const gif::ColorA8u*	src = touch(static_cast<size_t>(ty) * static_cast<size_t>(mTilesAcross) + static_cast<size_t>(tx));
+				std::memcpy(dst, src + (static_cast<size_t>(ly) * static_cast<size_t>(mTileSize)), count * sizeof(gif::ColorA8u));
+			}
+			dst += count;
+		}
+	}
+}
+
+gif::ColorA8u* TiledCanvas::touch(const size_t index) {
+	Tile&					tile = mTiles[index];
+	if (!tile.mPixels.empty()) return tile.mPixels.data();
+
+	if (mMaxResident > 0) {
+		while (mResident.size() >= mMaxResident) evict();
+	}
+
+	const size_t			pixel_count = static_cast<size_t>(mTileSize) * static_cast<size_t>(mTileSize);
+	tile.mPixels.resize(pixel_count);
+	if (tile.mSpilled) {
+		const std::streamoff	offset = static_cast<std::streamoff>(index) * static_cast<std::streamoff>(pixel_count * sizeof(gif::ColorA8u));
+		mSpill.seekg(offset);
+		mSpill.read(reinterpret_cast<char*>(tile.mPixels.data()), pixel_count * sizeof(gif::ColorA8u));
+		if (!mSpill) throw std::runtime_error("TiledCanvas failed reading spill file");
+	}
+	mResident.push_back(index);
+	return tile.mPixels.data();
+}
+
+void TiledCanvas::evict() {
+	if (mResident.empty()) return;
+	const size_t			index = mResident.front();
+	mResident.pop_front();
+
+	Tile&					tile = mTiles[index];
+	const size_t			bytes = tile.mPixels.size() * sizeof(gif::ColorA8u);
+	const std::streamoff	offset = static_cast<std::streamoff>(index) * static_cast<std::streamoff>(bytes);
+	mSpill.seekp(offset);
+	mSpill.write(reinterpret_cast<const char*>(tile.mPixels.data()), bytes);
+	if (!mSpill) throw std::runtime_error("TiledCanvas failed writing spill file");
+	tile.mSpilled = true;
+	// Actually release the memory
+	gif::Vector<gif::ColorA8u>(tile.mPixels.get_allocator()).swap(tile.mPixels);
+}
+
+} // namespace gif
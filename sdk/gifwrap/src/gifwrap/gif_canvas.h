@@ -0,0 +1,72 @@
+#ifndef GIFWRAP_GIFCANVAS_H_
+#define GIFWRAP_GIFCANVAS_H_
+
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include "gif_bitmap.h"
+
+namespace gif {
+
+/**
+ * @class gif::TiledCanvas
+ * @brief A large RGBA surface stored as square tiles.
+ * @description Tiles are only allocated the first time they're written, so
+ * untouched areas cost nothing and read as transparent. Optionally, the
+ * number of tiles kept in memory can be capped, in which case the oldest
+ * tiles are written to a spill file and paged back in when touched.
+ */
+class TiledCanvas {
+public:
+	TiledCanvas() = delete;
+	TiledCanvas(const TiledCanvas&) = delete;
+	TiledCanvas(const int32_t width, const int32_t height, const int32_t tile_size = 256);
+	~TiledCanvas();
+
+	// Keep at most max_resident tiles in memory, spilling the rest to the file
+	// at path, which is created and then deleted when I'm destroyed. The cap is
+	// raised to a full row of tiles plus one, the working set of a decode.
+	// Throw if the file can't be opened.
+	void						setSpill(const std::string &path, const size_t max_resident);
+
+	int32_t						width() const { return mWidth; }
+	int32_t						height() const { return mHeight; }
+	int32_t						tileSize() const { return mTileSize; }
+	size_t						residentTiles() const { return mResident.size(); }
+
+	// Answer a writable pointer to pixel x,y, and in count the number of pixels
+	// that can be written from it before the tile edge. The pointer is valid until
+	// the next call on me. x,y must be inside the canvas.
+	gif::ColorA8u*				row(const int32_t x, const int32_t y, int32_t &count);
+	// Copy the rows starting at top into band, which is sized to my width
+	// and the lesser of height and the remaining rows.
+	void						readBand(const int32_t top, const int32_t height, gif::Bitmap &band);
+
+private:
+	struct Tile {
+		gif::Vector<gif::ColorA8u>	mPixels;
+		bool						mSpilled = false;
+	};
+
+	// Answer the pixels of the tile, allocating or paging it in as needed.
+	gif::ColorA8u*				touch(const size_t index);
+	void						evict();
+
+	const int32_t				mWidth,
+								mHeight,
+								mTileSize,
+								mTilesAcross,
+								mTilesDown;
+	gif::Vector<Tile>			mTiles;
+	// Indexes of tiles holding memory, oldest first.
+	std::deque<size_t>			mResident;
+	size_t						mMaxResident = 0;
+
+	std::string					mSpillPath;
+	std::fstream				mSpill;
+};
+
+} // namespace gif
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <vector>
+#include "gif_memory.h"
 
 namespace gif {
 
@@ -28,11 +29,13 @@ struct ColorA8u {
  */
 struct Palette {
 	Palette() { }
+	explicit Palette(gif::MemoryResource *r) : mColors(gif::Allocator<gif::ColorA8u>(r)) { }
 
 	bool						empty() const { return mColors.empty(); }
 	size_t						size() const { return mColors.size(); }
 
-	// Color tables need to be a power of 2, so expand or clip if needed
+	// Color tables need to be a power of 2, so expand or clip if needed.
+	// Expanding goes to the smallest size that fits, at least GIF's smallest table.
 	void						clip(const size_t max_size = 1<<8) {
 		// Clip
 		if (mColors.size() >= max_size) {
@@ -40,18 +43,12 @@ struct Palette {
 			return;
 		}
 		// Expand
-		size_t					last_size = max_size;
-		for (size_t bits=8; bits>=2; --bits) {
-			const size_t		size = 1<<bits;
-			if (mColors.size() >= size) {
-				mColors.resize(last_size);
-				return;
-			}
-			last_size = size;
-		}
+		size_t					size = 1<<2;
+		while (size < mColors.size() && size < max_size) size *= 2;
+		mColors.resize(size);
 	}
 
-	std::vector<gif::ColorA8u>	mColors;
+	gif::Vector<gif::ColorA8u>	mColors;
 };
 
 } // namespace gif
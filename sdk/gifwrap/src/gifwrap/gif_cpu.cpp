@@ -0,0 +1,515 @@
+#include "gif_cpu.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define GIFWRAP_X86		1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// AVX-512 intrinsics need a newer compiler than the rest.
+#if defined(GIFWRAP_X86) && (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5) || (defined(_MSC_VER) && _MSC_VER >= 1911))
+#define GIFWRAP_AVX512	1
+#endif
+
+// GCC and clang only emit vector instructions in functions that ask for them.
+// MSVC emits whatever intrinsics it's given.
+#if defined(__GNUC__)
+#define GIFWRAP_TARGET(t)	__attribute__((target(t)))
+#else
+#define GIFWRAP_TARGET(t)
+#endif
+
+namespace gif {
+
+namespace {
+
+// Channel value for unused palette entries. Far enough from 0-255 that an
+// unused entry's distance always loses to a real one, small enough that
+// three of them still fit in an int16_t.
+const int16_t			UNUSED_CHANNEL = 2000;
+
+/**
+ * SCALAR
+ * The reference implementations. Every other variant must match these exactly.
+ */
+void					expand_palette_scalar(	const uint8_t *src, const size_t count, const gif::PackedPalette &p,
+												const uint32_t transparent, gif::ColorA8u *dst) {
+	for (size_t k=0; k<count; ++k) {
+		if (src[k] != transparent) dst[k] = p.mColors[src[k]];
+	}
+}
+
+void					match_row_scalar(const gif::ColorA8u *src, const size_t count, const gif::PackedPalette &p, uint8_t *dst) {
+	for (size_t k=0; k<count; ++k) {
+		const int32_t	r = src[k].r, g = src[k].g, b = src[k].b;
+		int32_t			best_d = 0x7fffffff;
+		size_t			best_i = 0;
+		for (size_t i=0; i<p.mSize; ++i) {
+			const int32_t	d = std::abs(r - p.mR[i]) + std::abs(g - p.mG[i]) + std::abs(b - p.mB[i]);
+			if (d < best_d) {
+				best_d = d;
+				best_i = i;
+			}
+		}
+		dst[k] = static_cast<uint8_t>(best_i);
+	}
+}
+
+// Counting is a scatter, which doesn't vectorise profitably, so every level uses this.
+void					histogram_row_scalar(const gif::ColorA8u *src, const size_t count, const uint32_t bits, uint32_t *bins) {
+	const uint32_t		shift = 8 - bits;
+	for (size_t k=0; k<count; ++k) {
+		const uint32_t	i = (static_cast<uint32_t>(src[k].r >> shift) << (2 * bits))
+							| (static_cast<uint32_t>(src[k].g >> shift) << bits)
+							| static_cast<uint32_t>(src[k].b >> shift);
+		++bins[i];
+	}
+}
+
+bool					diff_row_scalar(const gif::ColorA8u *a, const gif::ColorA8u *b, const size_t count, size_t &first, size_t &last) {
+	size_t				k = 0;
+	while (k < count && a[k] == b[k]) ++k;
+	if (k == count) return false;
+	size_t				e = count;
+	while (e > k && a[e-1] == b[e-1]) --e;
+	first = k;
+	last = e;
+	return true;
+}
+
+bool					within_row_scalar(const gif::ColorA8u *a, const gif::ColorA8u *b, const size_t count, const uint8_t tolerance) {
+	const uint8_t		*pa = reinterpret_cast<const uint8_t*>(a),
+						*pb = reinterpret_cast<const uint8_t*>(b);
+	for (size_t k=0; k<count*4; ++k) {
+		const uint8_t	d = (pa[k] > pb[k] ? pa[k] - pb[k] : pb[k] - pa[k]);
+		if (d > tolerance) return false;
+	}
+	return true;
+}
+
+// Finish a vector match: each lane holds its best distance and the index that
+// produced it. Take the smallest distance, then the smallest index.
+uint8_t					reduce_match(const int16_t *dist, const int16_t *index, const size_t lanes) {
+	int32_t				best = 0x7fffffff;
+	for (size_t k=0; k<lanes; ++k) {
+		const int32_t	key = (static_cast<int32_t>(dist[k]) << 8) | static_cast<int32_t>(index[k]);
+		if (key < best) best = key;
+	}
+	return static_cast<uint8_t>(best & 0xff);
+}
+
+#if defined(GIFWRAP_X86)
+/**
+ * SSE2
+ * No gather, so palette expansion stays scalar.
+ */
+GIFWRAP_TARGET("sse2")
+void					match_row_sse2(const gif::ColorA8u *src, const size_t count, const gif::PackedPalette &p, uint8_t *dst) {
+	const size_t		blocks = (p.mSize + 7) / 8;
+	int16_t				dist[8], index[8];
+	for (size_t k=0; k<count; ++k) {
+		const __m128i	r = _mm_set1_epi16(src[k].r),
+						g = _mm_set1_epi16(src[k].g),
+						b = _mm_set1_epi16(src[k].b),
+						step = _mm_set1_epi16(8);
+		__m128i			best = _mm_set1_epi16(0x7fff),
+						best_i = _mm_setzero_si128(),
+						idx = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+		for (size_t j=0; j<blocks; ++j) {
+			const __m128i	pr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p.mR + j*8)),
+							pg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p.mG + j*8)),
+							pb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p.mB + j*8));
+			// SSE2 has no abs, so take the larger of the two differences.
+			__m128i		d = _mm_max_epi16(_mm_sub_epi16(pr, r), _mm_sub_epi16(r, pr));
+			d = _mm_add_epi16(d, _mm_max_epi16(_mm_sub_epi16(pg, g), _mm_sub_epi16(g, pg)));
+			d = _mm_add_epi16(d, _mm_max_epi16(_mm_sub_epi16(pb, b), _mm_sub_epi16(b, pb)));
+			const __m128i	lt = _mm_cmplt_epi16(d, best);
+			best = _mm_min_epi16(d, best);
+			best_i = _mm_or_si128(_mm_and_si128(lt, idx), _mm_andnot_si128(lt, best_i));
+			idx = _mm_add_epi16(idx, step);
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dist), best);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(index), best_i);
+		dst[k] = reduce_match(dist, index, 8);
+	}
+}
+
+GIFWRAP_TARGET("sse2")
+bool					diff_row_sse2(const gif::ColorA8u *a, const gif::ColorA8u *b, const size_t count, size_t &first, size_t &last) {
+	size_t				k = 0;
+	while (k + 4 <= count) {
+		const __m128i	eq = _mm_cmpeq_epi32(	_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + k)),
+												_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + k)));
+		if (_mm_movemask_epi8(eq) != 0xffff) break;
+		k += 4;
+	}
+	while (k < count && a[k] == b[k]) ++k;
+	if (k == count) return false;
+
+	size_t				e = count;
+	while (e >= k + 4) {
+		const __m128i	eq = _mm_cmpeq_epi32(	_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + e - 4)),
+												_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + e - 4)));
+		if (_mm_movemask_epi8(eq) != 0xffff) break;
+		e -= 4;
+	}
+	while (e > k && a[e-1] == b[e-1]) --e;
+	first = k;
+	last = e;
+	return true;
+}
+
+GIFWRAP_TARGET("sse2")
+bool					within_row_sse2(const gif::ColorA8u *a, const gif::ColorA8u *b, const size_t count, const uint8_t tolerance) {
+	const __m128i		t = _mm_set1_epi8(static_cast<char>(tolerance));
+	size_t				k = 0;
+	for (; k + 4 <= count; k += 4) {
+		const __m128i	va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + k)),
+						vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + k)),
+						d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(d, t), t)) != 0xffff) return false;
+	}
+	return within_row_scalar(a + k, b + k, count - k, tolerance);
+}
+
+/**
+ * AVX2
+ */
+GIFWRAP_TARGET("avx2")
+void					expand_palette_avx2(const uint8_t *src, const size_t count, const gif::PackedPalette &p,
+											const uint32_t transparent, gif::ColorA8u *dst) {
+	const int*			table = reinterpret_cast<const int*>(p.mColors);
+	const __m256i		tv = _mm256_set1_epi32(static_cast<int>(transparent));
+	size_t				k = 0;
+	for (; k + 8 <= count; k += 8) {
+		const __m256i	idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + k)));
+		const __m256i	c = _mm256_i32gather_epi32(table, idx, 4);
+		const __m256i	keep = _mm256_cmpeq_epi32(idx, tv);
+		__m256i*		d = reinterpret_cast<__m256i*>(dst + k);
+		if (_mm256_testz_si256(keep, keep)) _mm256_storeu_si256(d, c);
+		else _mm256_storeu_si256(d, _mm256_blendv_epi8(c, _mm256_loadu_si256(d), keep));
+	}
+	expand_palette_scalar(src + k, count - k, p, transparent, dst + k);
+}
+
+GIFWRAP_TARGET("avx2")
+void					match_row_avx2(const gif::ColorA8u *src, const size_t count, const gif::PackedPalette &p, uint8_t *dst) {
+	const size_t		blocks = (p.mSize + 15) / 16;
+	int16_t				dist[16], index[16];
+	for (size_t k=0; k<count; ++k) {
+		const __m256i	r = _mm256_set1_epi16(src[k].r),
+						g = _mm256_set1_epi16(src[k].g),
+						b = _mm256_set1_epi16(src[k].b),
+						step = _mm256_set1_epi16(16);
+		__m256i			best = _mm256_set1_epi16(0x7fff),
+						best_i = _mm256_setzero_si256(),
+						idx = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+		for (size_t j=0; j<blocks; ++j) {
+			const __m256i	pr = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p.mR + j*16)),
+							pg = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p.mG + j*16)),
+							pb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p.mB + j*16));
+			__m256i		d = _mm256_abs_epi16(_mm256_sub_epi16(pr, r));
+			d = _mm256_add_epi16(d, _mm256_abs_epi16(_mm256_sub_epi16(pg, g)));
+			d = _mm256_add_epi16(d, _mm256_abs_epi16(_mm256_sub_epi16(pb, b)));
+			const __m256i	lt = _mm256_cmpgt_epi16(best, d);
+			best = _mm256_min_epi16(d, best);
+			best_i = _mm256_blendv_epi8(best_i, idx, lt);
+			idx = _mm256_add_epi16(idx, step);
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dist), best);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(index), best_i);
+		dst[k] = reduce_match(dist, index, 16);
+	}
+}
+
+GIFWRAP_TARGET("avx2")
+bool					diff_row_avx2(const gif::ColorA8u *a, const gif::ColorA8u *b, const size_t count, size_t &first, size_t &last) {
+	size_t				k = 0;
+	while (k + 8 <= count) {
+		const __m256i	eq = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k)),
+												_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k)));
+		if (_mm256_movemask_epi8(eq) != -1) break;
+		k += 8;
+	}
+	while (k < count && a[k] == b[k]) ++k;
+	if (k == count) return false;
+
+	size_t				e = count;
+	while (e >= k + 8) {
+		const __m256i	eq = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + e - 8)),
+												_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + e - 8)));
+		if (_mm256_movemask_epi8(eq) != -1) break;
+		e -= 8;
+	}
+	while (e > k && a[e-1] == b[e-1]) --e;
+	first = k;
+	last = e;
+	return true;
+}
+
+GIFWRAP_TARGET("avx2")
+bool					within_row_avx2(const gif::ColorA8u *a, const gif::ColorA8u *b, const size_t count, const uint8_t tolerance) {
+	const __m256i		t = _mm256_set1_epi8(static_cast<char>(tolerance));
+	size_t				k = 0;
+	for (; k + 8 <= count; k += 8) {
+		const __m256i	va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k)),
+						vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k)),
+						d = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(d, t), t)) != -1) return false;
+	}
+	return within_row_scalar(a + k, b + k, count - k, tolerance);
+}
+#endif
+
+#if defined(GIFWRAP_AVX512)
+/**
+ * AVX-512
+ */
+GIFWRAP_TARGET("avx512f,avx512bw")
+void					expand_palette_avx512(	const uint8_t *src, const size_t count, const gif::PackedPalette &p,
+												const uint32_t transparent, gif::ColorA8u *dst) {
+	const int*			table = reinterpret_cast<const int*>(p.mColors);
+	const __m512i		tv = _mm512_set1_epi32(static_cast<int>(transparent));
+	size_t				k = 0;
+	for (; k + 16 <= count; k += 16) {
+		const __m512i	idx = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + k)));
+		const __m512i	c = _mm512_i32gather_epi32(idx, table, 4);
+		const __mmask16	write = _mm512_cmpneq_epi32_mask(idx, tv);
+		_mm512_mask_storeu_epi32(dst + k, write, c);
+	}
+	expand_palette_scalar(src + k, count - k, p, transparent, dst + k);
+}
+
+GIFWRAP_TARGET("avx512f,avx512bw")
+void					match_row_avx512(const gif::ColorA8u *src, const size_t count, const gif::PackedPalette &p, uint8_t *dst) {
+	const size_t		blocks = (p.mSize + 31) / 32;
+	int16_t				dist[32], index[32];
+	for (size_t k=0; k<count; ++k) {
+		const __m512i	r = _mm512_set1_epi16(src[k].r),
+						g = _mm512_set1_epi16(src[k].g),
+						b = _mm512_set1_epi16(src[k].b),
+						step = _mm512_set1_epi16(32);
+		__m512i			best = _mm512_set1_epi16(0x7fff),
+						best_i = _mm512_setzero_si512(),
+						// No setr_epi16 for 512 bits, so build the lane numbers from 32-bit pairs.
+						idx = _mm512_setr_epi32(	0x00010000, 0x00030002, 0x00050004, 0x00070006,
+													0x00090008, 0x000b000a, 0x000d000c, 0x000f000e,
+													0x00110010, 0x00130012, 0x00150014, 0x00170016,
+													0x00190018, 0x001b001a, 0x001d001c, 0x001f001e);
+		for (size_t j=0; j<blocks; ++j) {
+			const __m512i	pr = _mm512_loadu_si512(p.mR + j*32),
+							pg = _mm512_loadu_si512(p.mG + j*32),
+							pb = _mm512_loadu_si512(p.mB + j*32);
+			__m512i		d = _mm512_abs_epi16(_mm512_sub_epi16(pr, r));
+			d = _mm512_add_epi16(d, _mm512_abs_epi16(_mm512_sub_epi16(pg, g)));
+			d = _mm512_add_epi16(d, _mm512_abs_epi16(_mm512_sub_epi16(pb, b)));
+			const __mmask32	lt = _mm512_cmplt_epi16_mask(d, best);
+			best = _mm512_min_epi16(d, best);
+			best_i = _mm512_mask_mov_epi16(best_i, lt, idx);
+			idx = _mm512_add_epi16(idx, step);
+		}
+		_mm512_storeu_si512(dist, best);
+		_mm512_storeu_si512(index, best_i);
+		dst[k] = reduce_match(dist, index, 32);
+	}
+}
+
+GIFWRAP_TARGET("avx512f,avx512bw")
+bool					diff_row_avx512(const gif::ColorA8u *a, const gif::ColorA8u *b, const size_t count, size_t &first, size_t &last) {
+	size_t				k = 0;
+	while (k + 16 <= count) {
+		if (_mm512_cmpneq_epi32_mask(_mm512_loadu_si512(a + k), _mm512_loadu_si512(b + k)) != 0) break;
+		k += 16;
+	}
+	while (k < count && a[k] == b[k]) ++k;
+	if (k == count) return false;
+
+	size_t				e = count;
+	while (e >= k + 16) {
+		if (_mm512_cmpneq_epi32_mask(_mm512_loadu_si512(a + e - 16), _mm512_loadu_si512(b + e - 16)) != 0) break;
+		e -= 16;
+	}
+	while (e > k && a[e-1] == b[e-1]) --e;
+	first = k;
+	last = e;
+	return true;
+}
+
+GIFWRAP_TARGET("avx512f,avx512bw")
+bool					within_row_avx512(const gif::ColorA8u *a, const gif::ColorA8u *b, const size_t count, const uint8_t tolerance) {
+	const __m512i		t = _mm512_set1_epi8(static_cast<char>(tolerance));
+	size_t				k = 0;
+	for (; k + 16 <= count; k += 16) {
+		const __m512i	va = _mm512_loadu_si512(a + k),
+						vb = _mm512_loadu_si512(b + k),
+						d = _mm512_or_si512(_mm512_subs_epu8(va, vb), _mm512_subs_epu8(vb, va));
+		if (_mm512_cmpgt_epu8_mask(d, t) != 0) return false;
+	}
+	return within_row_scalar(a + k, b + k, count - k, tolerance);
+}
+#endif
+
+const Kernels			SCALAR_KERNELS = {	CpuLevel::kScalar, expand_palette_scalar, match_row_scalar,
+											histogram_row_scalar, diff_row_scalar, within_row_scalar };
+#if defined(GIFWRAP_X86)
+const Kernels			SSE2_KERNELS = {	CpuLevel::kSse2, expand_palette_scalar, match_row_sse2,
+											histogram_row_scalar, diff_row_sse2, within_row_sse2 };
+const Kernels			AVX2_KERNELS = {	CpuLevel::kAvx2, expand_palette_avx2, match_row_avx2,
+											histogram_row_scalar, diff_row_avx2, within_row_avx2 };
+#endif
+#if defined(GIFWRAP_AVX512)
+const Kernels			AVX512_KERNELS = {	CpuLevel::kAvx512, expand_palette_avx512, match_row_avx512,
+											histogram_row_scalar, diff_row_avx512, within_row_avx512 };
+#endif
+
+#if defined(GIFWRAP_X86)
+void					cpuid(int out[4], const int leaf, const int sub) {
+#if defined(_MSC_VER)
+	__cpuidex(out, leaf, sub);
+#else
+	__cpuid_count(leaf, sub, out[0], out[1], out[2], out[3]);
+#endif
+}
+
+// The register state the OS saves on a context switch.
+uint64_t				xgetbv0() {
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	uint32_t			eax = 0, edx = 0;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+#endif
+
+CpuLevel				detect() {
+	CpuLevel			level = CpuLevel::kScalar;
+#if defined(GIFWRAP_X86)
+	int					r[4] = { 0 };
+	cpuid(r, 0, 0);
+	const int			max_leaf = r[0];
+	if (max_leaf < 1) return level;
+
+	cpuid(r, 1, 0);
+	const bool			sse2 = (r[3] & (1<<26)) != 0,
+						osxsave = (r[2] & (1<<27)) != 0,
+						avx = (r[2] & (1<<28)) != 0;
+	if (!sse2) return level;
+	level = CpuLevel::kSse2;
+
+	if (!osxsave || !avx || max_leaf < 7) return level;
+	const uint64_t		xcr0 = xgetbv0();
+	// XMM and YMM state
+	if ((xcr0 & 0x6) != 0x6) return level;
+	cpuid(r, 7, 0);
+	if ((r[1] & (1<<5)) == 0) return level;
+	level = CpuLevel::kAvx2;
+
+#if defined(GIFWRAP_AVX512)
+	// Opmask and ZMM state, AVX-512 F and BW
+	const bool			avx512 = (xcr0 & 0xe6) == 0xe6 && (r[1] & (1<<16)) != 0 && (r[1] & (1<<30)) != 0;
+	if (avx512) level = CpuLevel::kAvx512;
+#endif
+#endif
+	return level;
+}
+
+// -1 until detected. Detection is idempotent, so a race just does it twice.
+std::atomic<int>		DETECTED(-1);
+std::atomic<const Kernels*>
+						ACTIVE(nullptr);
+
+}
+
+/**
+ * @class gif::PackedPalette
+ */
+void PackedPalette::setTo(const gif::ColorA8u *colors, const size_t size) {
+	mSize = (colors ? std::min<size_t>(size, 256) : 0);
+	for (size_t k=0; k<256; ++k) {
+		if (k < mSize) {
+			mColors[k] = colors[k];
+			mR[k] = colors[k].r;
+			mG[k] = colors[k].g;
+			mB[k] = colors[k].b;
+		} else {
+			mColors[k] = gif::ColorA8u(0, 0, 0, 0);
+			mR[k] = mG[k] = mB[k] = UNUSED_CHANNEL;
+		}
+	}
+}
+
+/**
+ * Dispatch
+ */
+CpuLevel cpu_detected_level() {
+	int					level = DETECTED.load();
+	if (level < 0) {
+		CpuLevel		l = detect();
+		// Let benchmarks cap the level without a rebuild.
+		const char*		env = std::getenv("GIFWRAP_CPU");
+		if (env) {
+			CpuLevel	cap = l;
+			if (std::strcmp(env, "scalar") == 0) cap = CpuLevel::kScalar;
+			else if (std::strcmp(env, "sse2") == 0) cap = CpuLevel::kSse2;
+			else if (std::strcmp(env, "avx2") == 0) cap = CpuLevel::kAvx2;
+			if (static_cast<int>(cap) < static_cast<int>(l)) l = cap;
+		}
+		level = static_cast<int>(l);
+		DETECTED.store(level);
+	}
+	return static_cast<CpuLevel>(level);
+}
+
+CpuLevel cpu_level() {
+	return kernels().mLevel;
+}
+
+CpuLevel set_cpu_level(const CpuLevel level) {
+	const Kernels&		k = kernels_for(level);
+	ACTIVE.store(&k);
+	return k.mLevel;
+}
+
+const char* cpu_level_name(const CpuLevel level) {
+	switch (level) {
+		case CpuLevel::kScalar:		return "scalar";
+		case CpuLevel::kSse2:		return "sse2";
+		case CpuLevel::kAvx2:		return "avx2";
+		case CpuLevel::kAvx512:		return "avx512";
+	}
+	return "unknown";
+}
+
+const Kernels& kernels() {
+	const Kernels*		k = ACTIVE.load();
+	if (!k) {
+		k = &kernels_for(cpu_detected_level());
+		ACTIVE.store(k);
+	}
+	return *k;
+}
+
+const Kernels& kernels_for(const CpuLevel requested) {
+	const CpuLevel		level = static_cast<CpuLevel>(std::min(static_cast<int>(requested), static_cast<int>(cpu_detected_level())));
+#if defined(GIFWRAP_AVX512)
+	if (level == CpuLevel::kAvx512) return AVX512_KERNELS;
+#endif
+#if defined(GIFWRAP_X86)
+	if (level >= CpuLevel::kAvx2) return AVX2_KERNELS;
+	if (level >= CpuLevel::kSse2) return SSE2_KERNELS;
+#endif
+	return SCALAR_KERNELS;
+}
+
+} // namespace gif
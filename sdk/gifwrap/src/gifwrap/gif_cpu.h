@@ -0,0 +1,88 @@
+#ifndef GIFWRAP_GIFCPU_H_
+#define GIFWRAP_GIFCPU_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "gif_color.h"
+
+/**
+ * Runtime selection of the vectorised inner loops. The CPU is probed once,
+ * and each kernel is bound to the best variant it supports. Every variant
+ * produces exactly the same output as the scalar reference, so a level can
+ * be forced (i.e. in tests and benchmarks) to check one against the other.
+ */
+
+namespace gif {
+
+enum class CpuLevel {	kScalar,
+						kSse2,
+						kAvx2,
+						// AVX-512 F and BW
+						kAvx512 };
+
+/**
+ * @class gif::PackedPalette
+ * @brief A palette laid out for the kernels.
+ * @description Always 256 entries. Colors past the palette size are
+ * transparent black, so any index can be expanded without a bounds check,
+ * and their channels are far out of range, so they never win a match.
+ */
+struct PackedPalette {
+	PackedPalette() { setTo(nullptr, 0); }
+
+	void						setTo(const gif::ColorA8u *colors, const size_t size);
+	void						setTo(const gif::Palette &p) { setTo(p.mColors.empty() ? nullptr : p.mColors.data(), p.mColors.size()); }
+
+	size_t						mSize = 0;
+	gif::ColorA8u				mColors[256];
+	// Channels as separate arrays for matching
+	int16_t						mR[256],
+								mG[256],
+								mB[256];
+};
+
+/**
+ * @class gif::Kernels
+ * @brief The hot loops, bound to one CPU level.
+ */
+struct Kernels {
+	CpuLevel					mLevel;
+
+	// Write palette color src[k] to dst[k], leaving dst[k] alone where src[k] is
+	// the transparent index. Pass a transparent value over 255 for none.
+	void						(*mExpandPalette)(	const uint8_t *src, const size_t count, const gif::PackedPalette&,
+													const uint32_t transparent, gif::ColorA8u *dst);
+	// For each pixel, the index of the palette color with the smallest summed
+	// RGB distance. The lowest index wins ties. The palette must not be empty.
+	void						(*mMatchRow)(	const gif::ColorA8u *src, const size_t count, const gif::PackedPalette&,
+												uint8_t *dst);
+	// Count each pixel into bins, which has 1<<(3*bits) entries, indexed by the
+	// top bits of r, g and b, in that order from most significant. bits is 1 to 8.
+	void						(*mHistogramRow)(const gif::ColorA8u *src, const size_t count, const uint32_t bits, uint32_t *bins);
+	// Find the pixels that differ between a and b. Answer false if none do,
+	// otherwise first and last (exclusive) bound the differences.
+	bool						(*mDiffRow)(	const gif::ColorA8u *a, const gif::ColorA8u *b, const size_t count,
+												size_t &first, size_t &last);
+	// Answer true if no channel of any pixel differs between a and b by more than tolerance.
+	bool						(*mWithinRow)(	const gif::ColorA8u *a, const gif::ColorA8u *b, const size_t count,
+												const uint8_t tolerance);
+};
+
+// The best level this CPU and build support, detected on first use.
+CpuLevel						cpu_detected_level();
+// The level the kernels are currently bound to.
+CpuLevel						cpu_level();
+// Bind the kernels for a level, clamped to cpu_detected_level(). Answer the level
+// actually used. Intended for tests and benchmarks; not safe to call while
+// kernels are running on other threads.
+CpuLevel						set_cpu_level(const CpuLevel);
+const char*						cpu_level_name(const CpuLevel);
+
+// The kernels for the current level.
+const Kernels&					kernels();
+// The kernels for a specific level, clamped to cpu_detected_level().
+const Kernels&					kernels_for(const CpuLevel);
+
+} // namespace gif
+
+#endif
@@ -0,0 +1,170 @@
+#include "gif_encoder.h"
+
+#include <algorithm>
+
+namespace gif {
+
+/**
+ * @class gif::PaletteFit
+ */
+void PaletteFit::setTo(const gif::Palette &p) {
+	mColors.clear();
+	for (const auto& c : p.mColors) mColors.push_back(pack(c));
+	std::sort(mColors.begin(), mColors.end());
+}
+
+bool PaletteFit::fits(const gif::BitmapView &bm) const {
+	if (mColors.empty()) return false;
+	for (int32_t y=0; y<bm.mHeight; ++y) {
+		const gif::ColorA8u*	row = bm.row(y);
+		uint32_t				last = pack(row[0]);
+		if (!std::binary_search(mColors.begin(), mColors.end(), last)) return false;
+		for (int32_t x=1; x<bm.mWidth; ++x) {
+			const uint32_t		c = pack(row[x]);
+			if (c == last) continue;
+			if (!std::binary_search(mColors.begin(), mColors.end(), c)) return false;
+			last = c;
+		}
+	}
+	return true;
+}
+
+/**
+ * @class gif::MostUsedQuantizer
+ */
+void MostUsedQuantizer::clear() {
+	mHistogram.clear();
+	mExact.clear();
+	mSampler.clear();
+}
+
+void MostUsedQuantizer::add(const gif::BitmapView &src) {
+	mHistogram.add(src);
+	mExact.add(src);
+	mSampler.add(src);
+}
+
+void MostUsedQuantizer::finish(const size_t max_size, gif::Palette &out) {
+	out.mColors.clear();
+	if (mHistogram.total() < 1 || max_size < 1) return;
+	if (mExact.finish(max_size, out)) return;
+
+	// The most used bins, ties going to the lower bin so the order is stable.
+	using Counter = std::pair<uint64_t, uint32_t>;
+	gif::Vector<Counter>		used;
+	const auto&					bins = mHistogram.bins();
+	for (size_t k=0; k<bins.size(); ++k) {
+		if (bins[k] > 0) used.push_back(Counter(bins[k], static_cast<uint32_t>(k)));
+	}
+	const auto					order = [](const Counter &a, const Counter &b)->bool{ return a.first > b.first || (a.first == b.first && a.second < b.second); };
+	if (used.size() > max_size) {
+		std::partial_sort(used.begin(), used.begin() + max_size, used.end(), order);
+		used.resize(max_size);
+	} else {
+		std::sort(used.begin(), used.end(), order);
+	}
+
+	// Average the sampled pixels in each kept bin.
+	mSlots.assign(bins.size(), -1);
+	for (size_t k=0; k<used.size(); ++k) mSlots[used[k].second] = static_cast<int32_t>(k);
+	gif::Vector<uint64_t>		sums(used.size() * 4, 0);
+	const gif::BitmapView		samples = mSampler.view();
+	for (int32_t x=0; x<samples.mWidth; ++x) {
+		const gif::ColorA8u&	c = samples.mPixels[x];
+		const int32_t			slot = mSlots[mHistogram.binOf(c)];
+		if (slot < 0) continue;
+		uint64_t*				sum = sums.data() + static_cast<size_t>(slot) * 4;
+		sum[0] += c.r;
+		sum[1] += c.g;
+		sum[2] += c.b;
+		sum[3] += 1;
+	}
+
+	out.mColors.reserve(max_size);
+	for (size_t k=0; k<used.size(); ++k) {
+		const uint64_t*			sum = sums.data() + k * 4;
+		const uint64_t			n = sum[3], half = sum[3] / 2;
+		// A bin the sample missed falls back to its center
+		if (n < 1) out.mColors.push_back(mHistogram.colorOf(used[k].second));
+		else out.mColors.push_back(gif::ColorA8u(	static_cast<uint8_t>((sum[0] + half) / n),
+													static_cast<uint8_t>((sum[1] + half) / n),
+													static_cast<uint8_t>((sum[2] + half) / n), 255));
+	}
+}
+
+void MostUsedQuantizer::convert(const gif::BitmapView &src, const size_t max_size, gif::Palette &out) {
+	clear();
+	add(src);
+	finish(max_size, out);
+}
+
+/**
+ * @func gif::changed_area()
+ */
+gif::Rect	changed_area(const gif::BitmapView &a, const gif::BitmapView &b) {
+	gif::Rect				area(a.mWidth, a.mHeight, 0, 0);
+	const auto				diff_row = gif::kernels().mDiffRow;
+	const size_t			w = static_cast<size_t>(a.mWidth);
+	for (int32_t y=0; y<a.mHeight; ++y) {
+		size_t				first, last;
+		if (!diff_row(a.row(y), b.row(y), w, first, last)) continue;
+		if (area.mTop > y) area.mTop = y;
+		area.mBottom = y + 1;
+		area.mLeft = std::min(area.mLeft, static_cast<int32_t>(first));
+		area.mRight = std::max(area.mRight, static_cast<int32_t>(last));
+	}
+	if (area.empty()) return gif::Rect();
+	return area;
+}
+
+/**
+ * @func gif::mask_unchanged()
+ */
+void		mask_unchanged(	const gif::BitmapView &prev, const gif::BitmapView &cur,
+							const uint8_t transparent, gif::PalettedBitmap &pbm) {
+	const size_t			w = static_cast<size_t>(cur.mWidth);
+	for (int32_t y=0; y<cur.mHeight; ++y) {
+		const gif::ColorA8u	*a = prev.row(y),
+							*b = cur.row(y);
+		uint8_t*			dst = pbm.mPixels.data() + static_cast<size_t>(y) * w;
+		size_t				first, last;
+		if (!gif::kernels().mDiffRow(a, b, w, first, last)) {
+			std::memset(dst, transparent, w);
+			continue;
+		}
+		std::memset(dst, transparent, first);
+		std::memset(dst + last, transparent, w - last);
+		for (size_t x=first; x<last; ++x) {
+			if (a[x] == b[x]) dst[x] = transparent;
+		}
+	}
+}
+
+/**
+ * @func gif::frames_within()
+ */
+bool		frames_within(const gif::BitmapView &a, const gif::BitmapView &b, const uint8_t tolerance) {
+	const gif::Kernels&		k = gif::kernels();
+	const size_t			w = static_cast<size_t>(a.mWidth);
+	size_t					first, last;
+	for (int32_t y=0; y<a.mHeight; ++y) {
+		if (tolerance < 1) {
+			if (k.mDiffRow(a.row(y), b.row(y), w, first, last)) return false;
+		} else if (!k.mWithinRow(a.row(y), b.row(y), w, tolerance)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @func gif::copy_area()
+ */
+void		copy_area(const gif::BitmapView &src, const gif::Rect &area, gif::Bitmap &dst) {
+	const size_t			w = static_cast<size_t>(dst.mWidth);
+	for (int32_t y=0; y<src.mHeight; ++y) {
+		std::copy(src.row(y), src.row(y) + src.mWidth, dst.mPixels.begin() + static_cast<size_t>(area.mTop + y) * w + area.mLeft);
+	}
+}
+
+} // namespace gif
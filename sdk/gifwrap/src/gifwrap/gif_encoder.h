@@ -0,0 +1,861 @@
+#ifndef GIFWRAP_GIFENCODER_H_
+#define GIFWRAP_GIFENCODER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "gif_algorithm.h"
+#include "gif_block.h"
+#include "gif_cpu.h"
+#include "gif_histogram.h"
+#include "gif_quantize.h"
+#include "gif_spool.h"
+#include "gif_thread.h"
+#include "lzw_writer.h"
+
+/**
+ * The encoder pipeline with its algorithms as compile-time policies.
+ * A policy is any class with the matching members:
+ * Quantizer	void convert(const gif::BitmapView&, const size_t max_size, gif::Palette&)
+ *				void clear(), void add(const gif::BitmapView&),
+ *				void finish(const size_t max_size, gif::Palette&) (one palette for many bitmaps)
+ * Matcher		void setTo(const gif::Palette&)
+ *				size_t match(const gif::ColorA8u&) const
+ *				void matchRow(const gif::ColorA8u*, uint8_t*, const size_t count) const
+ * Mapper		bool convert(const gif::BitmapView&, const Matcher&, gif::PalettedBitmap&)
+ * Since nothing is virtual, the per-pixel matching can be inlined into the
+ * mapper's loop. With encode threads, each thread gets a copy of the Matcher
+ * and Mapper, so those must copy into independent instances. The Plugin* policies forward to the runtime plug-ins in
+ * gif_algorithm.h, which is how gif::WriterT is built.
+ */
+
+namespace gif {
+
+// Decide how to create color table(s).
+// * kGlobalTableFromFirst -- create a global color table based solely on
+// the first frame of data. This is (potentially) the most memory-efficient
+// mode, as each frame can be written and then discarded.
+// * kGlobalTableFromAll -- create a global color table based on all frames.
+// This will likely result in the best balance of final output quality and
+// file size. Frames are counted and spooled (to a temporary file by default, so
+// memory stays bounded) as they arrive, then written against the final table on finish().
+// * kLocalTable -- each frame gets its own table, of the smallest size that
+// fits its colors. The first frame's table is the global one, and frames that
+// fit the global table or the previous frame's table reuse it, skipping the
+// quantizer (and, for the global table, the table bytes).
+enum class TableMode {	kGlobalTableFromFirst,
+						kGlobalTableFromAll,
+						kLocalTable };
+
+/**
+ * @class gif::WriterSettings
+ * @brief Private internal class.
+ */
+class WriterSettings {
+public:
+	WriterSettings(gif::MemoryResource *r = nullptr) : mGlobalPalette(r) { }
+
+	int32_t						mWidth = 0,
+								mHeight = 0;
+	uint8_t						mBackgroundColorIndex = 0;
+	TableMode					mTableMode = TableMode::kGlobalTableFromFirst;
+	bool						mDeltaFrames = false;
+	bool						mMergeFrames = false;
+	uint8_t						mMergeTolerance = 0;
+	// Times to repeat the animation after the first play, 0 for forever, or -1 to write
+	// no loop block and leave it to the viewer (usually a single play).
+	int32_t						mLoopCount = -1;
+	// Split images of at least mStripMinPixels into this many horizontal strips (1 is off).
+	size_t						mStrips = 1,
+								mStripMinPixels = 0;
+	gif::Palette				mGlobalPalette;
+};
+
+/**
+ * @class gif::PaletteFit
+ * @brief Answer whether every pixel of a bitmap is exactly a palette color.
+ * @description The palette is held as sorted packed RGB, and runs of the same
+ * color are only looked up once.
+ */
+class PaletteFit {
+public:
+	PaletteFit(gif::MemoryResource *r = nullptr) : mColors(gif::Allocator<uint32_t>(r)) { }
+
+	void						setTo(const gif::Palette&);
+	bool						fits(const gif::BitmapView&) const;
+
+private:
+	static uint32_t				pack(const gif::ColorA8u &c) {
+		return (static_cast<uint32_t>(c.r) << 16) | (static_cast<uint32_t>(c.g) << 8) | static_cast<uint32_t>(c.b);
+	}
+
+	gif::Vector<uint32_t>		mColors;
+};
+
+/**
+ * @class gif::VectorStreambuf
+ * @brief An output streambuf that appends to a gif::Vector.
+ * @description Lets the stream writers encode into memory from a
+ * gif::MemoryResource. Seeking isn't supported.
+ */
+class VectorStreambuf : public std::streambuf {
+public:
+	VectorStreambuf() { }
+
+	// Append to v from now on, or nullptr to fail every write.
+	void						setTo(gif::Vector<uint8_t> *v) { mTarget = v; }
+
+protected:
+	int_type					overflow(int_type c) override {
+		if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+		if (!mTarget) return traits_type::eof();
+		mTarget->push_back(static_cast<uint8_t>(c));
+		return c;
+	}
+	std::streamsize				xsputn(const char *s, std::streamsize n) override {
+		if (!mTarget) return 0;
+		const uint8_t*			src = reinterpret_cast<const uint8_t*>(s);
+		mTarget->insert(mTarget->end(), src, src + n);
+		return n;
+	}
+
+private:
+	gif::Vector<uint8_t>*		mTarget = nullptr;
+};
+
+/**
+ * @class gif::MostUsedQuantizer
+ * @brief Quantizer policy that keeps the most frequent colors.
+ * @description A source with no more colors than the palette comes through
+ * exactly: every pixel is also counted in a gif::ExactColors, which gives up
+ * past 256 colors. Otherwise the colors are counted in a gif::Histogram, and
+ * each of the most used bins becomes the average of the pixels that fell in
+ * it (from a gif::PixelSampler, so exact up to its limit).
+ */
+class MostUsedQuantizer {
+public:
+	MostUsedQuantizer(const uint32_t bits = 6) : mHistogram(bits) { }
+
+	// Configure subsampling and threads here.
+	gif::Histogram&				histogram() { return mHistogram; }
+
+	void						clear();
+	void						add(const gif::BitmapView&);
+	void						finish(const size_t max_size, gif::Palette&);
+
+	void						convert(const gif::BitmapView&, const size_t max_size, gif::Palette&);
+
+private:
+	gif::Histogram				mHistogram;
+	gif::ExactColors			mExact;
+	gif::PixelSampler			mSampler;
+	// The palette slot of each bin, or -1
+	gif::Vector<int32_t>		mSlots;
+};
+
+/**
+ * @class gif::NearestRgbMatcher
+ * @brief Matcher policy, the palette entry with the smallest summed RGB distance.
+ * Rows go through the CPU dispatched kernel.
+ */
+class NearestRgbMatcher {
+public:
+	NearestRgbMatcher() { }
+
+	void						setTo(const gif::Palette &p) { mPacked.setTo(p); }
+	size_t						match(const gif::ColorA8u &c) const {
+		int32_t					best_d = 0x7fffffff;
+		size_t					best_i = 0;
+		for (size_t i=0; i<mPacked.mSize; ++i) {
+			const int32_t		dr = static_cast<int32_t>(c.r) - mPacked.mR[i],
+								dg = static_cast<int32_t>(c.g) - mPacked.mG[i],
+								db = static_cast<int32_t>(c.b) - mPacked.mB[i];
+			const int32_t		d = (dr < 0 ? -dr : dr) + (dg < 0 ? -dg : dg) + (db < 0 ? -db : db);
+			if (d < best_d) {
+				best_d = d;
+				best_i = i;
+			}
+		}
+		return best_i;
+	}
+	void						matchRow(const gif::ColorA8u *src, uint8_t *dst, const size_t count) const {
+		if (mPacked.mSize < 1) std::memset(dst, 0, count);
+		else gif::kernels().mMatchRow(src, count, mPacked, dst);
+	}
+
+private:
+	gif::PackedPalette			mPacked;
+};
+
+/**
+ * @class gif::RowMapper
+ * @brief Mapper policy that hands the matcher a row at a time.
+ */
+class RowMapper {
+public:
+	RowMapper() { }
+
+	template <typename Matcher>
+	bool						convert(const gif::BitmapView &bm, const Matcher &m, gif::PalettedBitmap &pbm) {
+		pbm.clear();
+		if (bm.empty()) return false;
+		pbm.setTo(bm.mWidth, bm.mHeight);
+		const size_t			w = static_cast<size_t>(bm.mWidth);
+		for (int32_t y=0; y<bm.mHeight; ++y) {
+			m.matchRow(bm.row(y), pbm.mPixels.data() + static_cast<size_t>(y) * w, w);
+		}
+		return true;
+	}
+};
+
+/**
+ * @class gif::PluginQuantizer
+ * @brief Quantizer policy that forwards to a BitmapToPalette, the default if none is set.
+ */
+class PluginQuantizer {
+public:
+	PluginQuantizer() { }
+
+	void						clear() { plugin().clear(); }
+	void						add(const gif::BitmapView &bm) { plugin().add(bm); }
+	void						finish(const size_t max_size, gif::Palette &out) { plugin().finish(max_size, out); }
+
+	void						convert(const gif::BitmapView &bm, const size_t max_size, gif::Palette &out) {
+		plugin().convert(bm, max_size, out);
+	}
+
+	BitmapToPalette&			plugin() {
+		if (!mPlugin) mPlugin = BitmapToPalette::create();
+		return *mPlugin;
+	}
+
+	BitmapToPaletteRef			mPlugin;
+};
+
+/**
+ * @class gif::PluginMatcher
+ * @brief Matcher policy that forwards to a ToColorIndex, the default if none is set.
+ * @description Matching goes through a memo in front of the plug-in, so colors
+ * seen in earlier frames are answered without asking it again.
+ */
+class PluginMatcher {
+public:
+	PluginMatcher() { }
+	// The copy gets its own clone of the plug-in. Throw if it can't be cloned.
+	PluginMatcher(const PluginMatcher &o) : mPlugin(o.mPlugin ? o.mPlugin->clone() : nullptr) {
+		if (o.mPlugin && !mPlugin) throw std::runtime_error("gif::PluginMatcher ToColorIndex can't be cloned");
+	}
+
+	void						setTo(const gif::Palette &p) {
+		if (!mPlugin) mPlugin = ToColorIndex::create();
+		if (mMemoSource != mPlugin) {
+			mMemo = ToColorIndex::createMemo(mPlugin);
+			mMemoSource = mPlugin;
+		}
+		mMemo->setTo(p);
+	}
+	size_t						match(const gif::ColorA8u &c) const { return mMemo->match(c); }
+	void						matchRow(const gif::ColorA8u *src, uint8_t *dst, const size_t count) const {
+		mMemo->matchRow(src, dst, count);
+	}
+
+	ToColorIndexRef				mPlugin;
+	// What's actually matched with, and the plug-in it was made for.
+	ToColorIndexRef				mMemo,
+								mMemoSource;
+};
+
+/**
+ * @class gif::PluginMapper
+ * @brief Mapper policy that forwards to a ToPalettedBitmap, the default if none is set.
+ */
+class PluginMapper {
+public:
+	PluginMapper() { }
+	// The copy gets its own clone of the plug-in. Throw if it can't be cloned.
+	PluginMapper(const PluginMapper &o) : mPlugin(o.mPlugin ? o.mPlugin->clone() : nullptr) {
+		if (o.mPlugin && !mPlugin) throw std::runtime_error("gif::PluginMapper ToPalettedBitmap can't be cloned");
+	}
+
+	bool						convert(const gif::BitmapView &bm, const PluginMatcher &m, gif::PalettedBitmap &pbm) {
+		if (!mPlugin) mPlugin = ToPalettedBitmap::create();
+		return mPlugin->convert(bm, m.mMemo, pbm);
+	}
+
+	ToPalettedBitmapRef			mPlugin;
+};
+
+/**
+ * @class gif::EncoderT
+ * @brief Write RGBA frames into a GIF file, with the algorithms fixed at compile time.
+ * GIF spec: http://www.w3.org/Graphics/GIF/spec-gif89a.txt
+ */
+template <typename Quantizer = WuQuantizer, typename Matcher = NearestRgbMatcher, typename Mapper = RowMapper>
+class EncoderT {
+public:
+	EncoderT() = delete;
+	EncoderT(const EncoderT&) = delete;
+	// Buffers and encoder tables draw from the memory resource r (nullptr for the default).
+	EncoderT(const std::string &path, gif::MemoryResource *r = nullptr);
+	~EncoderT();
+
+	EncoderT&				setTableMode(TableMode m) { mSettings.mTableMode = m; return *this; }
+	EncoderT&				setBackgroundColorIndex(const uint8_t v) { mSettings.mBackgroundColorIndex = v; return *this; }
+	// How many times to repeat the animation after the first play, so it plays v + 1 times
+	// (the NETSCAPE2.0 loop count): 0 for forever, -1 (the default) to write no loop block.
+	EncoderT&				setLoopCount(const int32_t v) { mSettings.mLoopCount = v; return *this; }
+	// Write only the area of each frame that changed since the previous one, with the
+	// unchanged pixels inside it transparent. Costs one color in every table.
+	EncoderT&				setDeltaFrames(const bool v) { mSettings.mDeltaFrames = v; return *this; }
+	// Fold a frame into the previous one, by adding to its delay, when no channel of any
+	// pixel differs from it by more than tolerance.
+	EncoderT&				setMergeFrames(const bool v, const uint8_t tolerance = 0) {
+		mSettings.mMergeFrames = v;
+		mSettings.mMergeTolerance = tolerance;
+		return *this;
+	}
+	// With kGlobalTableFromAll, frames are held until finish(), by default in an anonymous
+	// temporary file. Hold them in the file at path instead, which is deleted afterwards.
+	// Throw if it can't be opened.
+	EncoderT&				setSpool(const std::string &path) { mSpool.setPath(path); return *this; }
+	// Hold them in memory instead, which grows with every frame.
+	EncoderT&				setSpoolInMemory() { mSpool.setInMemory(); return *this; }
+	// Map and LZW encode frames on threads worker threads, with up to queue_size more
+	// waiting (0 is twice the thread count). Choosing areas, tables and delays stays on
+	// the caller's thread, and images are written in frame order. Each thread works with
+	// a copy of the matcher and mapper taken at the first frame after this call, so
+	// configure them first. The memory resource must be safe to call from multiple threads.
+	// Set threads to 0 to turn encoding back to synchronous. Throw on a pending job's error.
+	EncoderT&				setEncodeThreads(const size_t threads, const size_t queue_size = 0);
+	// Write images of at least min_pixels as count horizontal strips, each its own image
+	// and LZW stream, so encode threads can work on one large frame at once. The last
+	// strip carries the frame's delay and the others have none. Some viewers show a zero
+	// delay as 0.1 seconds, so this is for stills and slow animations. Set count to 1 to turn it off.
+	EncoderT&				setStrips(const size_t count, const size_t min_pixels = 1<<20) {
+		mSettings.mStrips = std::max<size_t>(count, 1);
+		mSettings.mStripMinPixels = min_pixels;
+		return *this;
+	}
+
+	// Access to the policies, i.e. to configure them. Touching the matcher
+	// has it reread the palette on the next frame.
+	Quantizer&				quantizer() { return mQuantizer; }
+	Matcher&				matcher() { mMatcherStale = true; return mMatcher; }
+	Mapper&					mapper() { return mMapper; }
+
+	// Add the frame to the file, shown for delay seconds. The first frame sets the screen
+	// size. Delays are rounded to GIF's hundredths against the running total, so the
+	// error doesn't accumulate. Throw on error. With kGlobalTableFromAll, the frame is only counted and spooled;
+	// the file is written in a second pass by finish(), once the palette is known.
+	void					writeFrame(const gif::BitmapView&, const double delay = 0.0);
+	// Write anything spooled, then the trailer, and close the file. Throw on error.
+	// Done automatically on destruction, but errors are lost there.
+	void					finish();
+
+private:
+	EncoderT&				operator=(const EncoderT&) = delete;
+
+	void					startFile();
+	// The most colors a quantizer may give a table, leaving room for the transparent slot.
+	size_t					tableColors() const { return mSettings.mDeltaFrames ? (1<<8) - 1 : 1<<8; }
+	// Reserve the transparent slot in a freshly quantized table, if needed, and pad it out.
+	// match gets the colors pixels may be matched to, which never include the slot.
+	void					finishTable(gif::Palette&, uint8_t &transparent, gif::Palette &match) const;
+	// Choose the frame's table under kLocalTable. Answer the local table, or nullptr for the global one.
+	const gif::Palette*		chooseLocalTable(const gif::BitmapView&);
+	void					writeImage(const gif::BitmapView&, const double delay);
+	// Add delay to the previous image's Graphic Control Extension, in place.
+	void					extendDelay(const double delay);
+	// Add delay to the running total. Answer the seconds, in whole hundredths, it adds to the file.
+	double					advanceDelay(const double delay);
+	// The number of strips to write area as.
+	int32_t					stripCount(const gif::Rect &area) const;
+
+	// Encode threads. A job is one image, mapped and encoded by a worker into its
+	// own buffer. The caller writes finished images, in order, from mPending.
+	struct EncodeContext {
+		EncodeContext(const Matcher &m, const Mapper &p, gif::MemoryResource *r)
+				: mMatcher(m), mMapper(p), mPalettedBitmap(r), mLzwWriter(r), mOutput(&mOutputBuffer), mBlockBuffer(mOutput, r) { }
+
+		Matcher								mMatcher;
+		Mapper								mMapper;
+		gif::PalettedBitmap					mPalettedBitmap;
+		LzwWriter							mLzwWriter;
+		// Writes into the current job's output
+		VectorStreambuf						mOutputBuffer;
+		std::ostream						mOutput;
+		WriterBuffer						mBlockBuffer;
+		// The table the matcher is set to, held so its address isn't reused
+		std::shared_ptr<const gif::Palette>	mMatched;
+	};
+	struct EncodeJob {
+		EncodeJob(gif::MemoryResource *r) : mPixels(r), mPrevious(r), mOutput(r) { }
+
+		// The area's pixels, and under delta frames the same area of the previous frame
+		gif::Bitmap							mPixels,
+											mPrevious;
+		// The local table to write, and the colors to match to
+		std::shared_ptr<const gif::Palette>	mTable,
+											mMatch;
+		bool								mLocal = false,
+											mMask = false;
+		gif::Rect							mArea;
+		uint8_t								mTransparent = 0;
+		// Set by the worker
+		gif::Vector<uint8_t>				mOutput;
+		bool								mDone = false;
+		std::exception_ptr					mError;
+	};
+	struct PendingImage {
+		GraphicControlExtension				mGce;
+		std::shared_ptr<EncodeJob>			mJob;
+	};
+	void					queueImage(	const GraphicControlExtension&, const gif::BitmapView &pixels,
+										const gif::Rect &area, const gif::Palette *local, const bool delta);
+	void					encodeJob(EncodeJob&);
+	// Write finished images from the front of the queue, waiting until no more than
+	// max_pending are left. Throw the first job error.
+	void					flushImages(const size_t max_pending);
+
+	gif::MemoryResource*	mResource;
+	WriterSettings			mSettings;
+	std::string				mPath;
+	bool					mNeedsHeader = true;
+	// The matcher needs setTo() before the next frame
+	bool					mMatcherStale = true;
+	Quantizer				mQuantizer;
+	Matcher					mMatcher;
+	Mapper					mMapper;
+	gif::PalettedBitmap		mPalettedBitmap;
+	// The global table's colors to match pixels to
+	gif::Palette			mGlobalMatch;
+	// kLocalTable: the previous frame's table and its colors to match to, and what the matcher is set to
+	gif::Palette			mLocalPalette,
+							mLocalMatch;
+	bool					mHasLocalPalette = false;
+	const gif::Palette*		mMatchedPalette = nullptr;
+	// Built from the match colors, not the written tables, whose padding isn't a real color.
+	PaletteFit				mGlobalFit,
+							mLocalFit;
+	// Delta and merged frames: the previous frame, and the transparent slot of each table
+	gif::Bitmap				mPrevious;
+	uint8_t					mGlobalTransparent = 0,
+							mLocalTransparent = 0;
+	size_t					mImageCount = 0;
+	// The previous image's Graphic Control Extension and where it was written
+	GraphicControlExtension	mLastGce;
+	std::streampos			mLastGcePos = -1;
+	// Delay requested so far, and in hundredths written so far, before and up to the previous image
+	double					mElapsed = 0.0;
+	int64_t					mElapsedUnits = 0,
+							mLastStartUnits = 0;
+	// Frames waiting for the second pass of kGlobalTableFromAll
+	FrameSpool				mSpool;
+	gif::Bitmap				mSpooled;
+	// Store the encoder so I can reuse memory
+	LzwWriter				mLzwWriter;
+	std::ofstream			mStream;
+	WriterBuffer			mBlockBuffer;
+	// Encode threads: snapshots of the tables that jobs hold on to, the workers'
+	// contexts, and the images not yet written
+	std::shared_ptr<const gif::Palette>
+							mGlobalMatchShared,
+							mLocalShared,
+							mLocalMatchShared;
+	std::vector<std::unique_ptr<EncodeContext>>
+							mContexts;
+	std::vector<EncodeContext*>
+							mFreeContexts;
+	std::deque<PendingImage>
+							mPending;
+	size_t					mMaxPending = 0;
+	std::mutex				mJobMutex;
+	std::condition_variable	mJobDone;
+	// Destroyed first, so the workers stop before the contexts and pending jobs they use.
+	std::unique_ptr<gif::ThreadPool>
+							mPool;
+};
+
+using Encoder = EncoderT<>;
+
+// Private writing API
+void		write_header(const gif::WriterSettings&, std::ostream &output);
+// local_ct is written as the image's local color table, or nullptr to use the global one.
+// area is where the image sits on the screen.
+void		write_table_based_image(const gif::WriterSettings&, const gif::Palette *local_ct,
+									const gif::Rect &area, const gif::PalettedBitmapView&,
+									LzwWriter&, WriterBuffer&, std::ostream &output);
+// The bounds of the pixels that differ between two bitmaps of the same size, empty if none do.
+gif::Rect	changed_area(const gif::BitmapView &a, const gif::BitmapView &b);
+// Set each index in pbm to transparent where the pixel in cur equals the one in prev.
+void		mask_unchanged(	const gif::BitmapView &prev, const gif::BitmapView &cur,
+							const uint8_t transparent, gif::PalettedBitmap &pbm);
+// Answer true if no channel of any pixel differs between a and b (the same size) by more than tolerance.
+bool		frames_within(const gif::BitmapView &a, const gif::BitmapView &b, const uint8_t tolerance);
+// Copy src over the area of dst.
+void		copy_area(const gif::BitmapView &src, const gif::Rect &area, gif::Bitmap &dst);
+
+/**
+ * @class gif::EncoderT IMPLEMENTATION
+ */
+template <typename Quantizer, typename Matcher, typename Mapper>
+EncoderT<Quantizer, Matcher, Mapper>::EncoderT(const std::string &path, gif::MemoryResource *r)
+		: mResource(r)
+		, mSettings(r)
+		, mPath(path)
+		, mPalettedBitmap(r)
+		, mGlobalMatch(r)
+		, mLocalPalette(r)
+		, mLocalMatch(r)
+		, mGlobalFit(r)
+		, mLocalFit(r)
+		, mPrevious(r)
+		, mSpool(r)
+		, mSpooled(r)
+		, mLzwWriter(r)
+		, mBlockBuffer(mStream, r) {
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+EncoderT<Quantizer, Matcher, Mapper>::~EncoderT() {
+	try {
+		finish();
+	} catch (std::exception const&) {
+	}
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+EncoderT<Quantizer, Matcher, Mapper>& EncoderT<Quantizer, Matcher, Mapper>::setEncodeThreads(const size_t threads, const size_t queue_size) {
+	flushImages(0);
+	mPool.reset();
+	mContexts.clear();
+	mFreeContexts.clear();
+	if (threads > 0) {
+		mPool.reset(new gif::ThreadPool(threads, queue_size));
+		// Enough images in flight to keep every worker and queue slot busy
+		mMaxPending = mPool->size() + (queue_size > 0 ? queue_size : mPool->size() * 2);
+	}
+	return *this;
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+void EncoderT<Quantizer, Matcher, Mapper>::writeFrame(const gif::BitmapView &pixels, const double delay) {
+	if (pixels.empty()) throw std::runtime_error("gif::Encoder::writeFrame() empty frame");
+
+	if (mSettings.mTableMode == TableMode::kGlobalTableFromAll) {
+		// First pass: count the colors and keep the frame for later.
+		if (mNeedsHeader && mSpool.size() < 1) {
+			mSettings.mWidth = pixels.mWidth;
+			mSettings.mHeight = pixels.mHeight;
+			if (mSettings.mWidth >= 1<<16 || mSettings.mHeight >= 1<<16) throw std::runtime_error("gif::Encoder::writeFrame() image is too large");
+			mQuantizer.clear();
+		}
+		if (!mNeedsHeader) throw std::runtime_error("gif::Encoder::writeFrame() frames can't be added after the file is written");
+		mQuantizer.add(pixels);
+		mSpool.add(pixels, delay);
+		return;
+	}
+
+	// Delay the initial writing until I receive frame data as a convenience, so clients don't
+	// need to specify a screen size but instead it can just be pulled from the bitmap.
+	if (mNeedsHeader) {
+		mSettings.mWidth = pixels.mWidth;
+		mSettings.mHeight = pixels.mHeight;
+		if (mSettings.mWidth >= 1<<16 || mSettings.mHeight >= 1<<16) throw std::runtime_error("gif::Encoder::writeFrame() image is too large");
+
+		if (mSettings.mTableMode == TableMode::kGlobalTableFromFirst || mSettings.mTableMode == TableMode::kLocalTable) {
+			mQuantizer.convert(pixels, tableColors(), mSettings.mGlobalPalette);
+			finishTable(mSettings.mGlobalPalette, mGlobalTransparent, mGlobalMatch);
+			if (mSettings.mTableMode == TableMode::kLocalTable) mGlobalFit.setTo(mGlobalMatch);
+		}
+		startFile();
+	}
+	writeImage(pixels, delay);
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+void EncoderT<Quantizer, Matcher, Mapper>::finish() {
+	if (mNeedsHeader && mSpool.size() > 0) {
+		// Second pass of kGlobalTableFromAll, against the palette from every frame.
+		mQuantizer.finish(tableColors(), mSettings.mGlobalPalette);
+		finishTable(mSettings.mGlobalPalette, mGlobalTransparent, mGlobalMatch);
+		mSpool.rewind();
+		bool					first = true;
+		double					delay = 0.0;
+		while (mSpool.next(mSpooled, delay)) {
+			if (first) startFile();
+			first = false;
+			writeImage(mSpooled, delay);
+		}
+		mSpool.clear();
+	}
+	flushImages(0);
+
+	if (mStream.is_open()) {
+		// Ending trailer byte
+		mStream.put(static_cast<char>(0x3b));
+		mStream.close();
+	}
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+void EncoderT<Quantizer, Matcher, Mapper>::startFile() {
+	mStream.open(mPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!mStream.is_open()) throw std::runtime_error("gif::Encoder can't open " + mPath);
+	mNeedsHeader = false;
+	mMatcherStale = true;
+	mHasLocalPalette = false;
+	mImageCount = 0;
+	mLastGcePos = -1;
+	mElapsed = 0.0;
+	mElapsedUnits = mLastStartUnits = 0;
+	mGlobalMatchShared = std::make_shared<const gif::Palette>(mGlobalMatch);
+	write_header(mSettings, mStream);
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+void EncoderT<Quantizer, Matcher, Mapper>::finishTable(gif::Palette &p, uint8_t &transparent, gif::Palette &match) const {
+	const size_t				max_size = 1<<8;
+	// A quantizer plug-in might not keep to the size it was given.
+	if (p.size() > tableColors()) p.mColors.resize(tableColors());
+	match.mColors.assign(p.mColors.begin(), p.mColors.end());
+	if (mSettings.mDeltaFrames) {
+		// The reserved slot repeats the first color, but it's left out of match
+		// so no pixel is ever mapped to it.
+		transparent = static_cast<uint8_t>(p.size());
+		p.mColors.push_back(p.empty() ? gif::ColorA8u(0, 0, 0) : p.mColors.front());
+	}
+	p.clip(max_size);
+	if (match.empty()) match.mColors.push_back(gif::ColorA8u(0, 0, 0));
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+const gif::Palette* EncoderT<Quantizer, Matcher, Mapper>::chooseLocalTable(const gif::BitmapView &pixels) {
+	// Frames that fit an existing table reuse it without quantizing.
+	if (mGlobalFit.fits(pixels)) return nullptr;
+	if (mHasLocalPalette && mLocalFit.fits(pixels)) return &mLocalPalette;
+
+	mQuantizer.convert(pixels, tableColors(), mLocalPalette);
+	finishTable(mLocalPalette, mLocalTransparent, mLocalMatch);
+	if (mLocalPalette.mColors == mSettings.mGlobalPalette.mColors && mLocalTransparent == mGlobalTransparent) {
+		mHasLocalPalette = false;
+		return nullptr;
+	}
+	mLocalFit.setTo(mLocalMatch);
+	mLocalShared = std::make_shared<const gif::Palette>(mLocalPalette);
+	mLocalMatchShared = std::make_shared<const gif::Palette>(mLocalMatch);
+	mHasLocalPalette = true;
+	// The table changed under the matcher
+	if (mMatchedPalette == &mLocalMatch) mMatcherStale = true;
+	return &mLocalPalette;
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+void EncoderT<Quantizer, Matcher, Mapper>::writeImage(const gif::BitmapView &frame, const double delay) {
+	const bool					same_size = mImageCount > 0 && mPrevious.mWidth == frame.mWidth && mPrevious.mHeight == frame.mHeight;
+	if (mSettings.mMergeFrames && same_size && frames_within(mPrevious, frame, mSettings.mMergeTolerance)) {
+		// The previous frame stays on screen, so later frames keep comparing against it.
+		extendDelay(delay);
+		return;
+	}
+
+	// With delta frames, only the area that changed since the previous frame is written.
+	// If nothing changed, a single transparent pixel stands in for the frame.
+	gif::Rect					area(0, 0, frame.mWidth, frame.mHeight);
+	const bool					delta = mSettings.mDeltaFrames && same_size;
+	if (delta) area = changed_area(mPrevious, frame);
+	const bool					unchanged = area.empty();
+	if (unchanged) area = gif::Rect(0, 0, 1, 1);
+	const gif::BitmapView		pixels = frame.sub(area);
+
+	const gif::Palette*			local = nullptr;
+	if (mSettings.mTableMode == TableMode::kLocalTable && mImageCount > 0 && !unchanged) local = chooseLocalTable(pixels);
+
+	GraphicControlExtension		gce;
+	mLastStartUnits = mElapsedUnits;
+	gce.mDelay = advanceDelay(delay);
+	if (mSettings.mDeltaFrames) {
+		// Each frame is drawn over the last, which shows through the transparent pixels.
+		gce.mDisposal = GraphicControlExtension::Disposal::kDoNotDispose;
+	}
+	if (delta) {
+		gce.mFlags |= GraphicControlExtension::TRANSPARENT_COLOR_F;
+		gce.mTransparencyIndex = (local ? mLocalTransparent : mGlobalTransparent);
+	}
+
+	if (!mPool) {
+		// The matcher (and anything it has cached) carries over between frames
+		// for as long as the table does.
+		const gif::Palette*		table = (local ? &mLocalMatch : &mGlobalMatch);
+		if (mMatcherStale || mMatchedPalette != table) {
+			mMatcher.setTo(*table);
+			mMatchedPalette = table;
+			mMatcherStale = false;
+		}
+	}
+
+	// Each strip is drawn over the ones before it, and the frame's delay
+	// waits on the last, once the whole frame is on screen.
+	const int32_t				strips = stripCount(area);
+	for (int32_t i=0; i<strips; ++i) {
+		const gif::Rect			strip(	area.mLeft, area.mTop + area.height() * i / strips,
+										area.mRight, area.mTop + area.height() * (i+1) / strips);
+		const gif::BitmapView	strip_pixels = frame.sub(strip);
+		GraphicControlExtension	strip_gce = gce;
+		if (strips > 1) {
+			strip_gce.mDisposal = GraphicControlExtension::Disposal::kDoNotDispose;
+			if (i+1 < strips) strip_gce.mDelay = 0.0;
+		}
+
+		if (mPool) {
+			queueImage(strip_gce, strip_pixels, strip, local, delta);
+			continue;
+		}
+		mMapper.convert(strip_pixels, mMatcher, mPalettedBitmap);
+		if (mPalettedBitmap.empty()) throw std::runtime_error("gif::Encoder::writeFrame() failed to convert to paletted bitmap");
+		if (delta) mask_unchanged(gif::BitmapView(mPrevious).sub(strip), strip_pixels, gce.mTransparencyIndex, mPalettedBitmap);
+
+		mLastGce = strip_gce;
+		mLastGcePos = mStream.tellp();
+		strip_gce.write(mStream);
+		write_table_based_image(mSettings, local, strip, mPalettedBitmap, mLzwWriter, mBlockBuffer, mStream);
+	}
+
+	if (mSettings.mDeltaFrames || mSettings.mMergeFrames) {
+		if (!delta) mPrevious.copyFrom(frame);
+		else if (!unchanged) copy_area(pixels, area, mPrevious);
+	}
+	++mImageCount;
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+double EncoderT<Quantizer, Matcher, Mapper>::advanceDelay(const double delay) {
+	mElapsed += std::max(delay, 0.0);
+	const int64_t				end = static_cast<int64_t>(std::floor(mElapsed * 100.0 + 0.5));
+	// One image holds at most 0xffff hundredths
+	const int64_t				units = std::min<int64_t>(end - mElapsedUnits, 0xffff - (mElapsedUnits - mLastStartUnits));
+	mElapsedUnits += units;
+	return static_cast<double>(units) / 100.0;
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+int32_t EncoderT<Quantizer, Matcher, Mapper>::stripCount(const gif::Rect &area) const {
+	const size_t				pixels = static_cast<size_t>(area.width()) * static_cast<size_t>(area.height());
+	if (mSettings.mStrips < 2 || pixels < mSettings.mStripMinPixels) return 1;
+	// Every strip gets at least one row
+	return static_cast<int32_t>(std::min<size_t>(mSettings.mStrips, static_cast<size_t>(area.height())));
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+void EncoderT<Quantizer, Matcher, Mapper>::queueImage(	const GraphicControlExtension &gce, const gif::BitmapView &pixels,
+														const gif::Rect &area, const gif::Palette *local, const bool delta) {
+	if (mContexts.empty()) {
+		for (size_t i=0; i<mPool->size(); ++i) {
+			mContexts.emplace_back(new EncodeContext(mMatcher, mMapper, mResource));
+			mFreeContexts.push_back(mContexts.back().get());
+		}
+	}
+
+	// The job gets copies of everything that changes once the next frame arrives.
+	std::shared_ptr<EncodeJob>	job = std::make_shared<EncodeJob>(mResource);
+	job->mPixels.copyFrom(pixels);
+	if (delta) job->mPrevious.copyFrom(gif::BitmapView(mPrevious).sub(area));
+	job->mTable = (local ? mLocalShared : nullptr);
+	job->mMatch = (local ? mLocalMatchShared : mGlobalMatchShared);
+	job->mLocal = (local != nullptr);
+	job->mMask = delta;
+	job->mArea = area;
+	job->mTransparent = gce.mTransparencyIndex;
+	mPending.push_back(PendingImage{gce, job});
+	mPool->add([this, job]() { encodeJob(*job); });
+	flushImages(mMaxPending);
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+void EncoderT<Quantizer, Matcher, Mapper>::encodeJob(EncodeJob &job) {
+	// There's a context for every worker, so one is always free.
+	EncodeContext*				c = nullptr;
+	{
+		std::lock_guard<std::mutex>		lock(mJobMutex);
+		c = mFreeContexts.back();
+		mFreeContexts.pop_back();
+	}
+	try {
+		if (c->mMatched != job.mMatch) {
+			c->mMatcher.setTo(*job.mMatch);
+			c->mMatched = job.mMatch;
+		}
+		c->mMapper.convert(job.mPixels, c->mMatcher, c->mPalettedBitmap);
+		if (c->mPalettedBitmap.empty()) throw std::runtime_error("gif::Encoder::writeFrame() failed to convert to paletted bitmap");
+		if (job.mMask) mask_unchanged(job.mPrevious, job.mPixels, job.mTransparent, c->mPalettedBitmap);
+
+		// Encoded straight into the job, so there's nothing to copy out
+		c->mOutputBuffer.setTo(&job.mOutput);
+		c->mOutput.clear();
+		write_table_based_image(mSettings, job.mLocal ? job.mTable.get() : nullptr, job.mArea, c->mPalettedBitmap,
+								c->mLzwWriter, c->mBlockBuffer, c->mOutput);
+		c->mOutputBuffer.setTo(nullptr);
+	} catch (...) {
+		job.mError = std::current_exception();
+	}
+	{
+		std::lock_guard<std::mutex>		lock(mJobMutex);
+		mFreeContexts.push_back(c);
+		job.mDone = true;
+	}
+	mJobDone.notify_all();
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+void EncoderT<Quantizer, Matcher, Mapper>::flushImages(const size_t max_pending) {
+	while (!mPending.empty()) {
+		PendingImage&			head = mPending.front();
+		{
+			std::unique_lock<std::mutex>	lock(mJobMutex);
+			if (!head.mJob->mDone) {
+				if (mPending.size() <= max_pending) return;
+				mJobDone.wait(lock, [&head]() { return head.mJob->mDone; });
+			}
+		}
+		if (head.mJob->mError) {
+			const std::exception_ptr	error = head.mJob->mError;
+			mPending.clear();
+			std::rethrow_exception(error);
+		}
+
+		mLastGce = head.mGce;
+		mLastGcePos = mStream.tellp();
+		head.mGce.write(mStream);
+		mStream.write(reinterpret_cast<const char*>(head.mJob->mOutput.data()), static_cast<std::streamsize>(head.mJob->mOutput.size()));
+		mPending.pop_front();
+	}
+}
+
+template <typename Quantizer, typename Matcher, typename Mapper>
+void EncoderT<Quantizer, Matcher, Mapper>::extendDelay(const double delay) {
+	if (!mPending.empty()) {
+		// The previous image isn't written yet
+		mPending.back().mGce.mDelay += advanceDelay(delay);
+		return;
+	}
+	mLastGce.mDelay += advanceDelay(delay);
+	const std::streampos		end = mStream.tellp();
+	mStream.seekp(mLastGcePos);
+	mLastGce.write(mStream);
+	mStream.seekp(end);
+	if (!mStream) throw std::runtime_error("gif::Encoder::writeFrame() failed to update a frame delay");
+}
+
+} // namespace gif
+
+#endif
@@ -5,10 +5,11 @@
 #include <cstdint>
 #include <iostream>
 #include <memory>
-#include <sstream>
 
 #include <unordered_map>
 #include <vector>
+#include "gif_canvas.h"
+#include "gif_cpu.h"
 #include "gif_list.h"
 #include "lzw_reader.h"
 
@@ -24,12 +25,22 @@ size_t				color_count(const size_t encoded) {
 	return static_cast<size_t>(std::pow(2, encoded+1));
 }
 
-int32_t				read_2_byte_int(const std::vector<char> &buffer, size_t &position) {
+int32_t				read_2_byte_int(const gif::Vector<char> &buffer, size_t &position) {
 	uint8_t		a = buffer[position++],
 				b = buffer[position++];
 	return (b<<8) | a;
 }
 
+// The inverse of color_count(), for a table of at least 4 entries.
+uint8_t				encode_color_count(size_t size) {
+	uint8_t			bits = 1;
+	while (size > 4) {
+		size /= 2;
+		++bits;
+	}
+	return bits;
+}
+
 uint8_t				count_bits(const uint8_t value) {
 	uint8_t			ans = 0;
 	for (size_t k=0; k<8; ++k) {
@@ -44,14 +55,59 @@ void				write_2_byte_int(const int16_t value, std::ostream &output) {
 	output << a << b;
 }
 
-std::string			read_string(const std::vector<char> &buffer, const size_t size, size_t &position) {
-	std::stringstream	buf;
-	for (size_t k=0; k<size; ++k) buf << buffer[position++];
-	return buf.str();
+std::string			read_string(const gif::Vector<char> &buffer, const size_t size, size_t &position) {
+	std::string			ans(buffer.begin()+position, buffer.begin()+position+size);
+	position += size;
+	return ans;
+}
+
+// Advance past a run of data sub-blocks without storing them.
+size_t				skip_sub_blocks(const gif::Vector<char> &buffer, size_t position) {
+	while (position < buffer.size()) {
+		const uint8_t	block_size = buffer[position++];
+		if (block_size == 0) break;
+		position += block_size;
+	}
+	return position;
+}
+
+// Walk the block grammar from position (just past the global color table)
+// and answer the number of image blocks, skipping over all the data.
+size_t				count_image_blocks(const gif::Vector<char> &buffer, size_t position) {
+	size_t			count = 0;
+	while (position < buffer.size()) {
+		const uint8_t	byte1 = buffer[position++];
+		if (byte1 == 0x21) {
+			// Extension label followed by sub-blocks
+			position = skip_sub_blocks(buffer, position + 1);
+		} else if (byte1 == IMAGE_DESCRIPTOR_LABEL) {
+			if (position + 9 > buffer.size()) break;
+			const uint8_t	fields = buffer[position + 8];
+			position += 9;
+			if ((fields&(1<<7)) != 0) position += 3 * color_count(fields&0x7);
+			// LZW minimum code size, then the image data
+			position = skip_sub_blocks(buffer, position + 1);
+			++count;
+		} else {
+			// Trailer or garbage, either way we're done
+			break;
+		}
+	}
+	return count;
 }
 
 struct ColorTable {
-	std::vector<gif::ColorA8u>	mColors;
+	ColorTable(gif::MemoryResource *r = nullptr) : mColors(r) { }
+
+	gif::Vector<gif::ColorA8u>	mColors;
+	// mColors laid out for the expansion kernel, kept in sync by read().
+	gif::PackedPalette			mPacked;
+
+	// Empty the table but keep the memory.
+	void			clear() {
+		mColors.clear();
+		mPacked.setTo(nullptr, 0);
+	}
 
 	void			from(const gif::Bitmap &src, const size_t max_size = (1<<8)) {
 		mColors.clear();
@@ -63,21 +119,23 @@ struct ColorTable {
 
 		// For now, just clip based the most-used colors. CLEARLY THIS NEEDS TO CHANGE
 		using Counter = std::pair<gif::ColorA8u, size_t>;
-		std::vector<Counter>						vec;
+		gif::Vector<Counter>						vec;
 		for (const auto& p : ct) vec.push_back(Counter(p.first, p.second));
 		std::sort(vec.begin(), vec.end(), [](const Counter &a, const Counter &b)->bool{return a.second > b.second;});
 		if (vec.size() > max_size) vec.resize(max_size);
 		mColors.reserve(max_size);
 		for (const auto& p : vec) mColors.push_back(p.first);
+		mPacked.setTo(mColors.data(), mColors.size());
 	}
 
-	size_t			read(const std::vector<char> &buffer, const size_t count, size_t position) {
+	size_t			read(const gif::Vector<char> &buffer, const size_t count, size_t position) {
 		for (size_t k=0; k<count; ++k) {
 			const uint8_t	r = buffer[position++],
 							g = buffer[position++],
 							b = buffer[position++];
 			mColors.push_back(gif::ColorA8u(r, g, b));
 		}
+		mPacked.setTo(mColors.data(), mColors.size());
 		return position;
 	}
 
@@ -85,7 +143,7 @@ struct ColorTable {
 		write(mColors, output);
 	}
 
-	void			write(const std::vector<gif::ColorA8u> &clrs, std::ostream &output) const {
+	void			write(const gif::Vector<gif::ColorA8u> &clrs, std::ostream &output) const {
 		for (const auto& c : clrs) {
 			output << c.r << c.g << c.b;
 		}
@@ -96,37 +154,77 @@ struct ColorTable {
 struct BlockReadArgs {
 	BlockReadArgs() = delete;
 	BlockReadArgs(const BlockReadArgs&) = delete;
-	BlockReadArgs(const int32_t screen_w, const int32_t screen_h, const ColorTable &global_ct, gif::ListConstructor &lc)
-			: mScreenWidth(screen_w), mScreenHeight(screen_h), mGlobalColorTable(global_ct), mConstructor(lc) { }
+	// The decoder and bitmaps are supplied by the caller so their memory can be reused.
+	BlockReadArgs(	const int32_t screen_w, const int32_t screen_h, const gif::Rect &crop,
+					const ColorTable &global_ct, gif::LzwReader &decoder, gif::AlignedBitmap &bitmap,
+					gif::Bitmap &band, gif::ListConstructor &lc)
+			: mScreenWidth(screen_w), mScreenHeight(screen_h)
+			, mCanvas(crop.empty() ? gif::Rect(0, 0, screen_w, screen_h) : crop.intersect(gif::Rect(0, 0, screen_w, screen_h)))
+			, mGlobalColorTable(global_ct), mDecoder(decoder), mBitmap(bitmap), mBand(band), mConstructor(lc) { }
+
+	// Store the canvas in tiles instead of a single bitmap.
+	void						setTiled(const int32_t tile_size, const std::string &spill_path, const size_t max_resident) {
+		mTiles.reset(new gif::TiledCanvas(mCanvas.width(), mCanvas.height(), tile_size));
+		if (!spill_path.empty()) mTiles->setSpill(spill_path, max_resident);
+	}
 
 	// Create the table and initialize the bitmap
 	// Provide the target area within the bitmap.
 	void						startLzwDecode(const int32_t left, const int32_t top, const int32_t width, const int32_t height) {
-		mBitmap.mWidth = mScreenWidth;
-		mBitmap.mHeight = mScreenHeight;
-		mBitmap.mPixels.resize(mScreenWidth * mScreenHeight);
+		if (!mTiles && !mStarted) {
+			// The bitmap might hold a previous file, so clear it out.
+			mBitmap.setTo(mCanvas.width(), mCanvas.height());
+			mBitmap.fill(gif::ColorA8u());
+		}
+		mStarted = true;
 		mBitmapIndexX = left;
 		mBitmapIndexY = top;
 		mLeft = left;
 		mTop = top;
 		mRight = left + width;
 		mBottom = top + height;
+		selectEmitter();
 	}
 
-	// A little annoying but this is defined later in the file because the Graphic Control Extension
-	// is not declared at this point.
-	void						addPixels(const std::vector<uint8_t> &indexes, const ColorTable &t);
+	// Write decoded indexes through the emitter chosen for the current image block.
+	void						addPixels(const uint8_t *indexes, const size_t size, const ColorTable &t) {
+		(this->*mEmit)(indexes, size, t);
+	}
+
+	// Send the current canvas to the constructor.
+	void						finishFrame(const double delay) {
+		if (!mTiles) {
+			mConstructor.addFrame(mBitmap, delay);
+			return;
+		}
+		const int32_t			h = mTiles->height(),
+								band_h = mTiles->tileSize();
+		for (int32_t top=0; top<h; top+=band_h) {
+			mTiles->readBand(top, band_h, mBand);
+			mConstructor.addFrameBand(mBand, top, h, delay);
+		}
+	}
 
 	const int32_t				mScreenWidth,
 								mScreenHeight;
+	// The area of the screen that is stored, in screen coordinates. Either the whole
+	// screen or the client's crop.
+	const gif::Rect				mCanvas;
 	const ColorTable&			mGlobalColorTable;
 
 	// Decoding
-	gif::LzwReader				mDecoder;
+	gif::LzwReader&				mDecoder;
 
 	// A single bitmap is constructed and maintained through each successive image,
 	// since the spec lets additional image data blocks leave pixels unmodified.
-	gif::Bitmap					mBitmap;
+	// It covers mCanvas. In tiled mode, the tiles replace the bitmap, and frames
+	// are sent out through the band. Rows are aligned for downstream kernels.
+	gif::AlignedBitmap&			mBitmap;
+	std::unique_ptr<gif::TiledCanvas>
+								mTiles;
+	gif::Bitmap&				mBand;
+	bool						mStarted = false;
+	// Current decode position, in screen coordinates
 	int32_t						mBitmapIndexX = 0,
 								mBitmapIndexY = 0;
 	// Target area, exclusive
@@ -135,6 +233,17 @@ struct BlockReadArgs {
 	// Will be cached from any GCE block before the current image block
 	GraphicControlExtensionRef	mGceRef;
 
+	// A little annoying but these are defined later in the file because the Graphic Control Extension
+	// is not declared at this point.
+	// Pick the emitPixels() instantiation that fits the current image block.
+	void						selectEmitter();
+	// The pixel loop, specialised on whether the block has a transparent index
+	// and whether it can reach outside the canvas (or into tiles).
+	template <bool Transparent, bool Clip>
+	void						emitPixels(const uint8_t *indexes, const size_t size, const ColorTable &t);
+	void						(BlockReadArgs::*mEmit)(const uint8_t*, const size_t, const ColorTable&) = nullptr;
+	uint32_t					mTransparentIndex = 0;
+
 	// Output
 	gif::ListConstructor&		mConstructor;
 };
@@ -149,7 +258,7 @@ struct Header {
 
 	bool			isGif() const { return mSig == SIG; }
 
-	size_t			read(const std::vector<char> &buffer, size_t position) {
+	size_t			read(const gif::Vector<char> &buffer, size_t position) {
 		mSig = read_string(buffer, 3, position);
 
 		std::string	v = read_string(buffer, 3, position);
@@ -180,7 +289,7 @@ struct LogicalScreen {
 
 	bool			hasGlobalColorTable() const { return (mFlags&GLOBAL_COLOR_TABLE_F) != 0; }
 
-	size_t			read(const std::vector<char> &buffer, size_t position) {
+	size_t			read(const gif::Vector<char> &buffer, size_t position) {
 		// Screen size
 		mScreenWidth = read_2_byte_int(buffer, position);
 		mScreenHeight = read_2_byte_int(buffer, position);
@@ -212,13 +321,7 @@ struct LogicalScreen {
 			// Has global color table flag
 			f |= 1<<7;
 			// Size of global color table
-			uint8_t		bits = 1;
-			size_t		size = global_ct_size;
-			while (size > 4) {
-				size /= 2;
-				++bits;
-			}
-			f |= bits;
+			f |= encode_color_count(global_ct_size);
 		}
 		// XXX Ideally this is based on an analysis of the original image,
 		// but I'm really not sure how this is ever used
@@ -239,7 +342,15 @@ public:
 	static const uint32_t	INTERLACE_F = (1<<1);
 	static const uint32_t	SORT_F = (1<<2);
 
-	ImageData() { }
+	ImageData(gif::MemoryResource *r = nullptr) : mColorTable(r) { }
+
+	// Prepare for reuse, keeping the color table memory.
+	void					clear() {
+		mLeftPosition = mTopPosition = mWidth = mHeight = 0;
+		mFlags = 0;
+		mSizeOfLocalColorTable = 0;
+		mColorTable.clear();
+	}
 
 	int32_t					mLeftPosition = 0,
 							mTopPosition = 0,
@@ -250,7 +361,7 @@ public:
 	ColorTable				mColorTable;
 
 	// We are past the image separator byte here
-	size_t					read(const std::vector<char> &buffer, size_t position, BlockReadArgs &bra) {
+	size_t					read(const gif::Vector<char> &buffer, size_t position, BlockReadArgs &bra) {
 		const ColorTable*	ct = &bra.mGlobalColorTable;
 
 		// Image descriptor
@@ -276,14 +387,14 @@ public:
 						block_size = 0;
 		bra.startLzwDecode(mLeftPosition, mTopPosition, mWidth, mHeight);
 		gif::LzwReader&	decoder(bra.mDecoder);
-		auto			flush_fn = [&bra, &ct](const std::vector<uint8_t> &data) { bra.addPixels(data, *ct); };
+		auto			flush_fn = [&bra, &ct](const uint8_t *data, const size_t size) { bra.addPixels(data, size, *ct); };
 		decoder.begin(lzw_code_size, flush_fn);
 		while ( (block_size = buffer[position++]) != 0) {
 			decoder.decode(buffer.begin()+position, buffer.begin()+(position+block_size));
 			position += block_size;
 		}
 		const double	delay = (bra.mGceRef ? bra.mGceRef->mDelay : 0.0);
-		bra.mConstructor.addFrame(bra.mBitmap, delay);
+		bra.finishFrame(delay);
 		return position;
 	}
 };
@@ -293,7 +404,7 @@ public:
 	AppExtension() { }
 
 	// We are past the introducer and app bytes here
-	size_t			read(const std::vector<char> &buffer, size_t position) {
+	size_t			read(const gif::Vector<char> &buffer, size_t position) {
 		uint8_t		block_size = buffer[position++];
 		if (block_size != 11) throw std::runtime_error("AppExtension has illegal Block Size");
 
@@ -303,15 +414,28 @@ public:
 		// authentication
 		for (size_t k=0; k<3; ++k) ++position;
 
-		return readSubBlocks(buffer, position);
+		// Nothing currently uses the application data
+		return skip_sub_blocks(buffer, position);
+	}
+
+	// Write the NETSCAPE2.0 extension that sets how many times to play the
+	// animation (0 for forever), including the introducer and label.
+	static void		writeLoopCount(const uint16_t count, std::ostream &output) {
+		output << static_cast<uint8_t>(0x21) << static_cast<uint8_t>(0xff) << static_cast<uint8_t>(11);
+		output << "NETSCAPE2.0";
+		output << static_cast<uint8_t>(3) << static_cast<uint8_t>(1);
+		write_2_byte_int(static_cast<int16_t>(count), output);
+		output << static_cast<uint8_t>(0);
 	}
 };
 
+// Read the blocks. A single instance of each block type is reused, since
+// nothing needs a block after the following image has been read.
 class BlockList {
 public:
-	BlockList() { }
+	BlockList(gif::MemoryResource *r = nullptr) : mGce(std::make_shared<GraphicControlExtension>()), mImage(r) { }
 
-	size_t			read(const uint8_t byte1, const std::vector<char> &buffer, size_t position, BlockReadArgs &bra) {
+	size_t			read(const uint8_t byte1, const gif::Vector<char> &buffer, size_t position, BlockReadArgs &bra) {
 		// Select between:
 		//		Image Descriptor				- 0x2c (image)
 		//		Graphic Control Extension		- 0x21 (extension), 0xf9 (graphic control)
@@ -332,24 +456,20 @@ public:
 				throw std::runtime_error("comment block unimplemented");
 			// graphic control
 			} else if (byte2 == 0xf9) {
-				std::shared_ptr<GraphicControlExtension>	block = std::make_shared<GraphicControlExtension>();
-				position = block->read(buffer, position);
+				*mGce = GraphicControlExtension();
+				position = mGce->read(buffer, position);
 				// Provide me to the next image block
-				bra.mGceRef = block;
-				mBlocks.push_back(block);
+				bra.mGceRef = mGce;
 			// application
 			} else if (byte2 == 0xff) {
-				std::shared_ptr<AppExtension>				block = std::make_shared<AppExtension>();
-				position = block->read(buffer, position);
-				mBlocks.push_back(block);
+				position = mApp.read(buffer, position);
 			} else {
 				throw std::runtime_error("Read block on invalid extension byte");
 			}
 		// Image
 		} else if (byte1 == IMAGE_DESCRIPTOR_LABEL) {
-			std::shared_ptr<ImageData>						block = std::make_shared<ImageData>();
-			position = block->read(buffer, position, bra);
-			mBlocks.push_back(block);
+			mImage.clear();
+			position = mImage.read(buffer, position, bra);
 			// Clear out my associated GCE
 			bra.mGceRef.reset();
 		} else {
@@ -358,36 +478,98 @@ public:
 		return position;
 	}
 
-	std::vector<BlockRef>	mBlocks;
+	GraphicControlExtensionRef	mGce;
+	AppExtension				mApp;
+	ImageData					mImage;
 };
 
 /**
  * BlockReadArgs
  * Need to implement a function after the Graphic Control Extension block is defined.
  */
-void BlockReadArgs::addPixels(const std::vector<uint8_t> &indexes, const ColorTable &t) {
+void BlockReadArgs::selectEmitter() {
 	const bool				has_transparent = (mGceRef && mGceRef->hasTransparentColor());
+	mTransparentIndex = (has_transparent ? mGceRef->mTransparencyIndex : 0);
+	// Blocks entirely inside an untiled canvas never need clipping.
+	const bool				clip = mTiles || !mCanvas.contains(mLeft, mTop) || mRight > mCanvas.mRight || mBottom > mCanvas.mBottom;
+	if (has_transparent) mEmit = (clip ? &BlockReadArgs::emitPixels<true, true> : &BlockReadArgs::emitPixels<true, false>);
+	else mEmit = (clip ? &BlockReadArgs::emitPixels<false, true> : &BlockReadArgs::emitPixels<false, false>);
+}
 
-	for (const auto& it : indexes) {
-		const size_t		bi = static_cast<size_t>((mBitmapIndexY * mScreenWidth) + mBitmapIndexX);
-		if (bi >= mBitmap.mPixels.size()) return;
-		if (++mBitmapIndexX >= mRight) {
+template <bool Transparent, bool Clip>
+void BlockReadArgs::emitPixels(const uint8_t *indexes, const size_t size, const ColorTable &t) {
+	if (mRight <= mLeft) return;
+
+	// Indexes past the end of the table expand to transparent black.
+	const gif::Kernels&		kernels = gif::kernels();
+	const uint32_t			skip = (Transparent ? mTransparentIndex : 256);
+
+	// Walk the indexes a row segment at a time. Only the clipped variant
+	// checks whether the segment lands inside the canvas.
+	size_t					pos = 0;
+	while (pos < size && mBitmapIndexY < mBottom) {
+		const size_t		run = std::min<size_t>(static_cast<size_t>(mRight - mBitmapIndexX), size - pos);
+		if (!Clip) {
+			gif::ColorA8u*	dst = mBitmap.row(mBitmapIndexY - mCanvas.mTop) + (mBitmapIndexX - mCanvas.mLeft);
+			kernels.mExpandPalette(indexes + pos, run, t.mPacked, skip, dst);
+		} else if (mBitmapIndexY >= mCanvas.mTop && mBitmapIndexY < mCanvas.mBottom) {
+			const int32_t	x0 = std::max(mBitmapIndexX, mCanvas.mLeft),
+							x1 = std::min(mBitmapIndexX + static_cast<int32_t>(run), mCanvas.mRight);
+			const uint8_t*	src = indexes + pos + (x0 - mBitmapIndexX);
+			if (x0 < x1 && !mTiles) {
+				gif::ColorA8u*	dst = mBitmap.row(mBitmapIndexY - mCanvas.mTop) + (x0 - mCanvas.mLeft);
+				kernels.mExpandPalette(src, static_cast<size_t>(x1 - x0), t.mPacked, skip, dst);
+			} else if (x0 < x1) {
+				// Split the segment at tile edges
+				for (int32_t x=x0; x<x1; ) {
+					int32_t		count = 0;
+					gif::ColorA8u*	dst = mTiles->row(x - mCanvas.mLeft, mBitmapIndexY - mCanvas.mTop, count);
+					count = std::min(count, x1 - x);
+					kernels.mExpandPalette(src, static_cast<size_t>(count), t.mPacked, skip, dst);
+					src += count;
+					x += count;
+				}
+			}
+		}
+		pos += run;
+		mBitmapIndexX += static_cast<int32_t>(run);
+		if (mBitmapIndexX >= mRight) {
 			mBitmapIndexX = mLeft;
 			++mBitmapIndexY;
 		}
-		if (has_transparent && it == mGceRef->mTransparencyIndex) continue;
-
-		if (it < t.mColors.size()) {
-			mBitmap.mPixels[bi] = t.mColors[it];
-		} else {
-			// error
-			mBitmap.mPixels[bi] = gif::ColorA8u(0, 0, 0, 0);
-		}
 	}
 }
 
 }
 
+/**
+ * @class gif::DecoderContext
+ */
+struct DecoderContext::Data {
+	Data(gif::MemoryResource *r)
+			: mBuffer(r), mGlobalColorTable(r), mBlocks(r), mDecoder(r), mBitmap(r), mBand(r) { }
+
+	gif::Vector<char>		mBuffer;
+	ColorTable				mGlobalColorTable;
+	BlockList				mBlocks;
+	gif::LzwReader			mDecoder;
+	gif::AlignedBitmap		mBitmap;
+	gif::Bitmap				mBand;
+};
+
+DecoderContext::DecoderContext(gif::MemoryResource *r)
+		: mResource(r)
+		, mData(new Data(r)) {
+}
+
+DecoderContext::~DecoderContext() {
+}
+
+void DecoderContext::clear() {
+	mData.reset();
+	mData.reset(new Data(mResource));
+}
+
 /**
  * @class gif::Reader
  */
@@ -396,16 +578,29 @@ Reader::Reader(std::string path)
 }
 
 bool Reader::read(gif::ListConstructor &constructor) {
+	DecoderContext			context;
+	return read(constructor, context);
+}
+
+bool Reader::read(gif::ListConstructor &constructor, gif::DecoderContext &context) {
 	try {
-		std::ifstream		input(mPath, std::ios::binary);
-		std::vector<char>	buffer(	(std::istreambuf_iterator<char>(input)), 
-									(std::istreambuf_iterator<char>()));
-		input.close();
+		DecoderContext::Data&	data(*context.mData);
+		gif::Vector<char>&	buffer(data.mBuffer);
+		{
+			std::ifstream	input(mPath, std::ios::binary | std::ios::ate);
+			if (!input) throw std::runtime_error("Can't open file");
+			const std::streamoff	size = static_cast<std::streamoff>(input.tellg());
+			if (size < 0) throw std::runtime_error("Can't read file size");
+			buffer.resize(static_cast<size_t>(size));
+			input.seekg(0);
+			if (size > 0 && !input.read(buffer.data(), size)) throw std::runtime_error("Can't read file");
+		}
 
 		Header				header;
 		LogicalScreen		screen;
-		ColorTable			globalColorTable;
-		BlockList			blocks;
+		ColorTable&			globalColorTable(data.mGlobalColorTable);
+		BlockList&			blocks(data.mBlocks);
+		globalColorTable.clear();
 
 		size_t				pos = 0;
 
@@ -423,7 +618,13 @@ bool Reader::read(gif::ListConstructor &constructor) {
 			pos = globalColorTable.read(buffer, color_count(screen.mSizeOfGlobalColorTable), pos);
 		}
 
-		BlockReadArgs		bra(screen.mScreenWidth, screen.mScreenHeight, globalColorTable, constructor);
+		constructor.reserveFrames(count_image_blocks(buffer, pos));
+
+		BlockReadArgs		bra(screen.mScreenWidth, screen.mScreenHeight, mCrop, globalColorTable,
+								data.mDecoder, data.mBitmap, data.mBand, constructor);
+		const size_t		pixels = static_cast<size_t>(bra.mCanvas.width()) * static_cast<size_t>(bra.mCanvas.height());
+		if (mTiled && pixels > mTiledThreshold) bra.setTiled(mTileSize, mSpillPath, mMaxResidentTiles);
+		else if (mMaxCanvasPixels > 0 && pixels > mMaxCanvasPixels) throw std::runtime_error("Logical screen is too large");
 		while (pos < buffer.size()) {
 			const uint8_t	byte1 = buffer[pos++];
 			if (byte1 == 0x3b) {
@@ -441,21 +642,21 @@ bool Reader::read(gif::ListConstructor &constructor) {
 	return false;
 }
 
-/**
- * @class gif::WriterSettings
- */
-void WriterSettings::makeGlobalTable(const gif::Bitmap &bm) {
-	if (!mBitmapToPalette) throw std::runtime_error("makeGlobalTable() missing BitmapToPalette algorithm");
-	const size_t		max_size = 1<<8;
-	mBitmapToPalette->convert(bm, max_size, mGlobalPalette);
-	mGlobalPalette.clip(max_size);
+Reader& Reader::setTiled(	const size_t threshold_pixels, const int32_t tile_size,
+							const std::string &spill_path, const size_t max_resident_tiles) {
+	mTiled = true;
+	mTiledThreshold = threshold_pixels;
+	mTileSize = tile_size;
+	mSpillPath = spill_path;
+	mMaxResidentTiles = max_resident_tiles;
+	return *this;
 }
 
 /**
  * @class gif::Writer
  */
-Writer::Writer(std::string path)
-		: base([this](const gif::Bitmap &src, gif::Bitmap &dst){convert(src, dst);}, path) {
+Writer::Writer(std::string path, gif::MemoryResource *r)
+		: base([this](const gif::Bitmap &src, gif::Bitmap &dst){convert(src, dst);}, path, r) {
 }
 
 void Writer::convert(const gif::Bitmap &src, gif::Bitmap &dst) const {
@@ -485,34 +686,44 @@ void		write_header(const gif::WriterSettings &s, std::ostream &output) {
 	if (s.mGlobalPalette.size() > 0) {
 		ColorTable().write(s.mGlobalPalette.mColors, output);
 	}
+
+	// Looping
+	if (s.mLoopCount >= 0) {
+		AppExtension::writeLoopCount(static_cast<uint16_t>(std::min<int32_t>(s.mLoopCount, 0xffff)), output);
+	}
 }
 
 /**
  * @func gif::write_table_based_image()
  * &brief Write the grammar for "<Table-Based Image>"
  */
-void		write_table_based_image(const gif::WriterSettings &s, const gif::Bitmap &bm, const PalettedBitmap &pbm,
+void		write_table_based_image(const gif::WriterSettings &s, const gif::Palette *local_ct,
+									const gif::Rect &area, const gif::PalettedBitmapView &pbm,
 									LzwWriter &lzw, WriterBuffer &wb, std::ostream &output) {
-		const gif::Palette*		ct = &s.mGlobalPalette;
+		const gif::Palette*		ct = (local_ct ? local_ct : &s.mGlobalPalette);
 
-		// Image descriptor. Currently don't support subareas
+		// Image descriptor
 		output << IMAGE_DESCRIPTOR_LABEL;
 
-		write_2_byte_int(0, output);	// left
-		write_2_byte_int(0, output);	// top
-		write_2_byte_int(static_cast<uint16_t>(s.mWidth), output);
-		write_2_byte_int(static_cast<uint16_t>(s.mHeight), output);
+		write_2_byte_int(static_cast<uint16_t>(area.mLeft), output);
+		write_2_byte_int(static_cast<uint16_t>(area.mTop), output);
+		write_2_byte_int(static_cast<uint16_t>(area.width()), output);
+		write_2_byte_int(static_cast<uint16_t>(area.height()), output);
 
-		// Currently don't support local color tables, interlacing or sorting		
+		// Currently don't support interlacing or sorting
 		uint8_t					fields = 0;
+		if (local_ct) fields |= (1<<7) | encode_color_count(local_ct->size());
 		output << fields;
 
+		// Local color table
+		if (local_ct) ColorTable().write(local_ct->mColors, output);
+
 		// Image data
 		const uint8_t				lzw_code_size = count_bits(static_cast<uint8_t>(ct->size()-1));
 		output << lzw_code_size;
 		wb.clear();
-		lzw.begin(lzw_code_size, [&wb](const std::vector<uint8_t> &data){wb.write(data);});
-		lzw.encode(pbm.mPixels);
+		lzw.begin(lzw_code_size, [&wb](const gif::Vector<uint8_t> &data){wb.write(data);});
+		lzw.encode(pbm);
 		wb.terminate();
 }
 
@@ -2,25 +2,38 @@
 #define GIFWRAP_GIFFILE_H_
 
 #include <stdexcept>
-#include "gif_algorithm.h"
 #include "gif_block.h"
+#include "gif_encoder.h"
 #include "gif_list.h"
-#include "lzw_writer.h"
 
 namespace gif {
 
-// Decide how to create color table(s).
-// * kGlobalTableFromFirst -- create a global color table based solely on
-// the first frame of data. This is (potentially) the most memory-efficient
-// mode, as each frame can be written and then discarded.
-// * kGlobalTableFromAll -- create a global color table based on all frames.
-// This will likely result in the best balance of final output quality and
-// file size, but at an up-front memory cost of requiring to load all frames
-// of data.
-// * kLocalTable -- a local color table is created for each frame.
-enum class TableMode {	kGlobalTableFromFirst,
-						kGlobalTableFromAll,
-						kLocalTable };
+/**
+ * @class gif::DecoderContext
+ * @brief Scratch memory for gif::Reader that can be reused across files.
+ * @description Owns the file buffer, color tables, blocks, canvas and LZW
+ * tables. Each buffer keeps its capacity between reads, so decoding a batch
+ * of similar files settles into no allocations. Not thread safe; use one
+ * context per thread.
+ */
+class DecoderContext {
+public:
+	// All buffers draw from the memory resource r (nullptr for the default), which must outlive me.
+	DecoderContext(gif::MemoryResource *r = nullptr);
+	DecoderContext(const DecoderContext&) = delete;
+	~DecoderContext();
+
+	// Release all held memory.
+	void				clear();
+
+private:
+	friend class Reader;
+	struct Data;
+	gif::MemoryResource*
+						mResource;
+	std::unique_ptr<Data>
+						mData;
+};
 
 /**
  * @class gif::Reader
@@ -31,76 +44,106 @@ class Reader {
 public:
 	Reader(std::string path);
 
+	// Restrict decoding to an area of the logical screen. The full LZW stream is
+	// still decoded, but only pixels inside the crop are stored and composited,
+	// and frames sent to the output are the size of the crop (clipped to the screen).
+	// An empty rect (the default) decodes the whole screen.
+	Reader&				setCrop(const gif::Rect &r) { mCrop = r; return *this; }
+
+	// Decode screens of more than threshold_pixels (after cropping) into a
+	// gif::TiledCanvas of tile_size tiles that are only allocated when touched,
+	// and deliver the frames through ListConstructor::addFrameBand() one band of
+	// tile_size rows at a time. If spill_path is set, no more than max_resident_tiles
+	// stay in memory and the rest are paged to that (temporary) file.
+	// A threshold of 0 always tiles, the default is to never tile.
+	Reader&				setTiled(	const size_t threshold_pixels, const int32_t tile_size = 256,
+									const std::string &spill_path = std::string(), const size_t max_resident_tiles = 0);
+	// Fail on files whose screen (after cropping) is more than max_pixels and isn't tiled,
+	// so a hostile header can't make me allocate gigabytes. The default is 1<<26 pixels
+	// (256MB of RGBA), 0 is no limit.
+	Reader&				setMaxCanvasPixels(const size_t max_pixels) { mMaxCanvasPixels = max_pixels; return *this; }
+
 	// Given a file path, load all frames of data to output.
 	// This peforms no validation that the file is valid.
 	// Answer false on error.
 	bool				read(gif::ListConstructor &output);
+	// Same as above, but use the buffers in the context.
+	bool				read(gif::ListConstructor &output, gif::DecoderContext&);
 
 private:
 	std::string			mPath;
-};
-
-/**
- * @class gif::WriterSettings
- * @brief Private internal class.
- */
-class WriterSettings {
-public:
-	WriterSettings() { }
-
-	void						makeGlobalTable(const gif::Bitmap&);
-
-	int32_t						mWidth = 0,
-								mHeight = 0;
-	uint8_t						mBackgroundColorIndex = 0;
-	TableMode					mTableMode = TableMode::kGlobalTableFromFirst;
-	gif::Palette				mGlobalPalette;
-
-	BitmapToPaletteRef			mBitmapToPalette;
-	ToColorIndexRef				mToColorIndex;
-	ToPalettedBitmapRef			mToPalettedBitmap;
+	gif::Rect			mCrop;
+	bool				mTiled = false;
+	size_t				mMaxCanvasPixels = 1<<26,
+						mTiledThreshold = 0,
+						mMaxResidentTiles = 0;
+	int32_t				mTileSize = 256;
+	std::string			mSpillPath;
 };
 
 /**
  * @class gif::WriterT
  * @brief Write image frames into a GIF file.
+ * @description A gif::EncoderT whose algorithms can be swapped at runtime.
+ * Use the EncoderT directly when they're known at compile time.
  * GIF spec: http://www.w3.org/Graphics/GIF/spec-gif89a.txt
  */
 template <typename T>
 class WriterT {
 public:
-	WriterT(std::function<void(const T&, gif::Bitmap&)>, std::string path);
+	// Frame buffers and encoder tables draw from the memory resource r (nullptr for the default).
+	WriterT(std::function<void(const T&, gif::Bitmap&)>, std::string path, gif::MemoryResource *r = nullptr);
 	virtual ~WriterT();
 
-	WriterT&				setTableMode(TableMode m) { mSettings.mTableMode = m; return *this; }
-	WriterT&				setBackgroundColorIndex(const uint8_t v) { mSettings.mBackgroundColorIndex = v; return *this; }
+	WriterT&				setTableMode(TableMode m) { mEncoder.setTableMode(m); return *this; }
+	WriterT&				setBackgroundColorIndex(const uint8_t v) { mEncoder.setBackgroundColorIndex(v); return *this; }
+	// How many times to repeat the animation after the first play: 0 for forever, -1 (the default) to write no loop block.
+	WriterT&				setLoopCount(const int32_t v) { mEncoder.setLoopCount(v); return *this; }
+	// Write only the area of each frame that changed since the previous one.
+	WriterT&				setDeltaFrames(const bool v) { mEncoder.setDeltaFrames(v); return *this; }
+	// Fold frames that match the previous one, within tolerance per channel, into its delay.
+	WriterT&				setMergeFrames(const bool v, const uint8_t tolerance = 0) { mEncoder.setMergeFrames(v, tolerance); return *this; }
+	// With kGlobalTableFromAll, spool frames to the file at path instead of a temporary file. Throw if it can't be opened.
+	WriterT&				setSpool(const std::string &path) { mEncoder.setSpool(path); return *this; }
+	// With kGlobalTableFromAll, spool frames in memory, which grows with every frame.
+	WriterT&				setSpoolInMemory() { mEncoder.setSpoolInMemory(); return *this; }
+	// Map and LZW encode frames on threads worker threads, writing them in order. Conversion
+	// from T stays on the caller's thread. Plug-ins must support clone(). 0 turns it off.
+	WriterT&				setEncodeThreads(const size_t threads, const size_t queue_size = 0) {
+		mEncoder.setEncodeThreads(threads, queue_size);
+		return *this;
+	}
+	// Write frames of at least min_pixels as count horizontal strips that can be encoded in parallel.
+	WriterT&				setStrips(const size_t count, const size_t min_pixels = 1<<20) {
+		mEncoder.setStrips(count, min_pixels);
+		return *this;
+	}
 
-	// Add the frame to the file. Throw on error.
-	void					writeFrame(const T&);
+	// Add the frame to the file, shown for delay seconds. Throw on error.
+	void					writeFrame(const T&, const double delay = 0.0);
+	// Add pixels that are already RGBA, skipping the convert function and its copy.
+	// The view can be part of a larger image or a foreign buffer. Throw on error.
+	void					writeView(const gif::BitmapView&, const double delay = 0.0);
+	// Complete the file. Throw on error. Done automatically on destruction, but errors are lost there.
+	void					finish() { mEncoder.finish(); }
 
 	// Various pluggable algorithms. Ignore for defaults.
 
 	// Create a palette from a bitmap.
-	WriterT&				setBitmapToPalette(BitmapToPaletteRef a = nullptr) { mSettings.mBitmapToPalette = a; return *this; }
+	WriterT&				setBitmapToPalette(BitmapToPaletteRef a = nullptr) { mEncoder.quantizer().mPlugin = a; return *this; }
 	// When converting a bitmap into a paletted bitmap, this determines how to match the RGBA color
 	// to the nearest palette color.
-	WriterT&				setToColorIndex(ToColorIndexRef a = nullptr) { mSettings.mToColorIndex = a; return *this; }
+	WriterT&				setToColorIndex(ToColorIndexRef a = nullptr) { mEncoder.matcher().mPlugin = a; return *this; }
 	// When converting a bitmap to a paletted bitmap, this determines how the full bitmap is processed.
-	WriterT&				setToPalettedBitmap(ToPalettedBitmapRef a = nullptr) { mSettings.mToPalettedBitmap = a; return *this; }
+	WriterT&				setToPalettedBitmap(ToPalettedBitmapRef a = nullptr) { mEncoder.mapper().mPlugin = a; return *this; }
 
 private:
-	WriterSettings			mSettings;
+	using Encoder = EncoderT<PluginQuantizer, PluginMatcher, PluginMapper>;
+
 	std::function<void(const T&, gif::Bitmap&)>
 							mConvertFn;
-	std::string				mPath;
-	bool					mNeedsHeader = true;
-	TableMode				mTableMode = TableMode::kGlobalTableFromFirst;
 	gif::Bitmap				mPixels;
-	PalettedBitmap			mPalettedBitmap;
-	// Store the encoder so I can reuse memory
-	LzwWriter				mLzwWriter;
-	std::ofstream			mStream;
-	WriterBuffer			mBlockBuffer;
+	Encoder					mEncoder;
 };
 
 /**
@@ -110,7 +153,7 @@ private:
  */
 class Writer : public WriterT<gif::Bitmap> {
 public:
-	Writer(std::string path);
+	Writer(std::string path, gif::MemoryResource *r = nullptr);
 
 private:
 	void					convert(const gif::Bitmap &src, gif::Bitmap &dst) const;
@@ -122,58 +165,29 @@ private:
  * @class gif::WriterT IMPLEMENTATION
  */
 template <typename T>
-WriterT<T>::WriterT(std::function<void(const T&, gif::Bitmap&)> convert_fn, std::string path)
+WriterT<T>::WriterT(std::function<void(const T&, gif::Bitmap&)> convert_fn, std::string path, gif::MemoryResource *r)
 		: mConvertFn(convert_fn)
-		, mPath(path)
-		, mBlockBuffer(mStream) {
+		, mPixels(r)
+		, mEncoder(path, r) {
 }
 
 template <typename T>
 WriterT<T>::~WriterT() {
-	if (mStream) {
-		// Ending trailer byte
-		mStream << 0x3b;
-	}
 }
 
 template <typename T>
-void WriterT<T>::writeFrame(const T &t) {
+void WriterT<T>::writeFrame(const T &t, const double delay) {
 	if (!mConvertFn) throw std::runtime_error("gif::Writer<T>::writeFrame() has no convert function");
 	mConvertFn(t, mPixels);
 	if (mPixels.empty()) throw std::runtime_error("gif::Writer<T>::writeFrame() conversion failed");
-
-	// Initialize my algorithms
-	if (!mSettings.mBitmapToPalette) mSettings.mBitmapToPalette = BitmapToPalette::create();
-	if (!mSettings.mToColorIndex) mSettings.mToColorIndex = ToColorIndex::create();
-	if (!mSettings.mToPalettedBitmap) mSettings.mToPalettedBitmap = ToPalettedBitmap::create();
-
-	// Delay the initial writing until I receive frame data as a convenience, so clients don't
-	// need to specify a screen size but instead it can just be pulled from the bitmap.
-	if (mNeedsHeader) {
-		mNeedsHeader = false;
-
-		mStream = std::ofstream(mPath, std::ios::out | std::ios::binary);
-
-		mSettings.mWidth = mPixels.mWidth;
-		mSettings.mHeight = mPixels.mHeight;
-		if (mSettings.mWidth >= 1<<16 || mSettings.mHeight >= 1<<16) throw std::runtime_error("gif::Writer<T>::writeFrame() image is too large");
-		if (mSettings.mTableMode == TableMode::kGlobalTableFromFirst) {
-			mSettings.makeGlobalTable(mPixels);
-		}
-		write_header(mSettings, mStream);
-	}
-
-	// Write the image data
-	mSettings.mToColorIndex->setTo(mSettings.mGlobalPalette);
-	mSettings.mToPalettedBitmap->convert(mPixels, mSettings.mToColorIndex, mPalettedBitmap);
-	if (mPalettedBitmap.empty()) throw std::runtime_error("gif::Writer<T>::writeFrame() failed to convert to paletted bitmap");
-	write_table_based_image(mSettings, mPixels, mPalettedBitmap, mLzwWriter, mBlockBuffer, mStream);
+	mEncoder.writeFrame(mPixels, delay);
 }
 
-// Private writing API
-void		write_header(const gif::WriterSettings&, std::ostream &output);
-void		write_table_based_image(const gif::WriterSettings&, const gif::Bitmap&, const PalettedBitmap&,
-									LzwWriter&, WriterBuffer&, std::ostream &output);
+template <typename T>
+void WriterT<T>::writeView(const gif::BitmapView &pixels, const double delay) {
+	if (pixels.empty()) throw std::runtime_error("gif::Writer<T>::writeView() empty frame");
+	mEncoder.writeFrame(pixels, delay);
+}
 
 } // namespace gif
 
@@ -0,0 +1,79 @@
+#ifndef GIFWRAP_GIFHASH_H_
+#define GIFWRAP_GIFHASH_H_
+
+#include <cstdint>
+#include <cstring>
+#include "gif_bitmap.h"
+
+namespace gif {
+
+/**
+ * @func gif::hash64()
+ * @brief Fast, non-cryptographic 64-bit hash of a byte range.
+ * @description Consumes 32 bytes per step over four independent lanes so the
+ * multiplies can overlap, then folds the lanes and the tail. Intended for
+ * fingerprinting frame data, so equal hashes still need to be verified.
+ */
+inline uint64_t		hash64(const void *data, const size_t size, const uint64_t seed = 0) {
+	static const uint64_t	P1 = 0x9E3779B185EBCA87ULL,
+							P2 = 0xC2B2AE3D27D4EB4FULL,
+							P3 = 0x165667B19E3779F9ULL;
+	auto					rotl = [](const uint64_t v, const int r)->uint64_t { return (v << r) | (v >> (64 - r)); };
+	auto					round = [&rotl](uint64_t acc, const uint64_t v)->uint64_t { acc += v * P2; return rotl(acc, 31) * P1; };
+
+	const uint8_t*			p = static_cast<const uint8_t*>(data);
+	const uint8_t* const	end = p + size;
+	uint64_t				h = seed + P3 + static_cast<uint64_t>(size);
+
+	if (size >= 32) {
+		uint64_t			v1 = seed + P1 + P2,
+							v2 = seed + P2,
+							v3 = seed,
+							v4 = seed - P1;
+		for (; p + 32 <= end; p += 32) {
+			uint64_t		k[4];
+			std::memcpy(k, p, sizeof(k));
+			v1 = round(v1, k[0]);
+			v2 = round(v2, k[1]);
+			v3 = round(v3, k[2]);
+			v4 = round(v4, k[3]);
+		}
+		h += rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = (h ^ round(0, v1)) * P1;
+		h = (h ^ round(0, v2)) * P1;
+		h = (h ^ round(0, v3)) * P1;
+		h = (h ^ round(0, v4)) * P1;
+	}
+	for (; p + 8 <= end; p += 8) {
+		uint64_t			k;
+		std::memcpy(&k, p, sizeof(k));
+		h = rotl(h ^ round(0, k), 27) * P1 + P3;
+	}
+	for (; p < end; ++p) {
+		h = rotl(h ^ (static_cast<uint64_t>(*p) * P3), 11) * P1;
+	}
+
+	// Final avalanche
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+	return h;
+}
+
+// Fingerprint the pixel contents (and size) of a bitmap. Rows are always hashed
+// one at a time, chained through the seed, so the answer doesn't depend on the stride.
+inline uint64_t		hash64(const gif::BitmapView &bm) {
+	uint64_t				seed = (static_cast<uint64_t>(static_cast<uint32_t>(bm.mWidth)) << 32)
+									| static_cast<uint64_t>(static_cast<uint32_t>(bm.mHeight));
+	if (bm.empty()) return hash64(nullptr, 0, seed);
+	for (int32_t y=0; y<bm.mHeight; ++y) {
+		seed = hash64(bm.row(y), static_cast<size_t>(bm.mWidth) * sizeof(gif::ColorA8u), seed);
+	}
+	return seed;
+}
+
+} // namespace gif
+
+#endif
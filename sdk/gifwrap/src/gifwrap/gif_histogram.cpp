@@ -0,0 +1,223 @@
+#include "gif_histogram.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include "gif_cpu.h"
+
+namespace gif {
+
+namespace {
+// Below this many rows a band isn't worth a job.
+const int32_t			MIN_BAND_ROWS = 16;
+// An unused ExactColors slot. Packed colors never set the top byte.
+const uint32_t			EMPTY = 0xffffffff;
+}
+
+/**
+ * @class gif::Histogram
+ */
+Histogram::Histogram(const uint32_t bits, gif::MemoryResource *r)
+		: mBits(bits)
+		, mResource(r)
+		, mBins(gif::Allocator<uint64_t>(r))
+		, mSums(gif::Allocator<uint64_t>(r))
+		, mBandBins(gif::Allocator<gif::Vector<uint32_t>>(r))
+		, mBandSums(gif::Allocator<gif::Vector<uint64_t>>(r)) {
+	if (bits < 1 || bits > 8) throw std::runtime_error("gif::Histogram bits must be 1 to 8");
+	mBins.assign(size_t(1) << (3 * bits), 0);
+}
+
+Histogram::~Histogram() {
+}
+
+Histogram& Histogram::setSubsample(const int32_t step) {
+	mSubsample = std::max<int32_t>(step, 1);
+	return *this;
+}
+
+Histogram& Histogram::setThreads(const size_t threads) {
+	mPool.reset();
+	if (threads > 0) mPool.reset(new gif::ThreadPool(threads));
+	return *this;
+}
+
+Histogram& Histogram::setChannelSums(const bool v) {
+	if (v) mSums.assign(mBins.size() * 3, 0);
+	else mSums.clear();
+	clear();
+	return *this;
+}
+
+gif::ColorA8u Histogram::colorOf(const size_t bin) const {
+	const uint32_t			shift = 8 - mBits,
+							mask = (1 << mBits) - 1,
+							half = (1 << shift) >> 1;
+	return gif::ColorA8u(	static_cast<uint8_t>((((bin >> (2 * mBits)) & mask) << shift) + half),
+							static_cast<uint8_t>((((bin >> mBits) & mask) << shift) + half),
+							static_cast<uint8_t>(((bin & mask) << shift) + half), 255);
+}
+
+void Histogram::clear() {
+	std::fill(mBins.begin(), mBins.end(), 0);
+	std::fill(mSums.begin(), mSums.end(), 0);
+	mTotal = 0;
+}
+
+void Histogram::add(const gif::BitmapView &bm) {
+	if (bm.empty()) return;
+
+	const int32_t			rows = (bm.mHeight + mSubsample - 1) / mSubsample;
+	mTotal += static_cast<uint64_t>(rows) * static_cast<uint64_t>(bm.mWidth);
+
+	// Each band counts into its own 32 bit table, which is folded into the 64 bit
+	// totals afterwards. No bin of one bitmap can overflow it.
+	const size_t			bands = std::max<size_t>(mPool ? std::min<size_t>(mPool->size(), static_cast<size_t>(rows / MIN_BAND_ROWS)) : 1, 1);
+	uint64_t*				sums = (mSums.empty() ? nullptr : mSums.data());
+	while (mBandBins.size() < bands) mBandBins.push_back(gif::Vector<uint32_t>(gif::Allocator<uint32_t>(mResource)));
+	if (bands < 2) {
+		mBandBins[0].assign(mBins.size(), 0);
+		addRows(bm, 0, bm.mHeight, mBandBins[0].data(), sums);
+		foldBins(mBandBins[0]);
+		return;
+	}
+
+	// Band edges fall on counted rows
+	const int32_t			band_rows = ((rows + static_cast<int32_t>(bands) - 1) / static_cast<int32_t>(bands)) * mSubsample;
+	while (mBandSums.size() < bands - 1) mBandSums.push_back(gif::Vector<uint64_t>(gif::Allocator<uint64_t>(mResource)));
+	for (size_t k=1; k<bands; ++k) {
+		gif::Vector<uint32_t>*	bins = &mBandBins[k];
+		gif::Vector<uint64_t>*	band_sums = (sums ? &mBandSums[k-1] : nullptr);
+		const int32_t			top = static_cast<int32_t>(k) * band_rows,
+								bottom = std::min(top + band_rows, bm.mHeight);
+		mPool->add([this, &bm, bins, band_sums, top, bottom]() {
+			bins->assign(mBins.size(), 0);
+			if (band_sums) band_sums->assign(mSums.size(), 0);
+			if (top < bottom) addRows(bm, top, bottom, bins->data(), band_sums ? band_sums->data() : nullptr);
+		});
+	}
+	mBandBins[0].assign(mBins.size(), 0);
+	addRows(bm, 0, std::min(band_rows, bm.mHeight), mBandBins[0].data(), sums);
+	mPool->wait();
+
+	for (size_t k=0; k<bands; ++k) foldBins(mBandBins[k]);
+	for (size_t k=1; k<bands; ++k) {
+		if (!sums) break;
+		const uint64_t*		src_sums = mBandSums[k-1].data();
+		for (size_t i=0; i<mSums.size(); ++i) mSums[i] += src_sums[i];
+	}
+}
+
+void Histogram::merge(const Histogram &h) {
+	if (h.mBits != mBits) throw std::runtime_error("gif::Histogram::merge() bits differ");
+	for (size_t i=0; i<mBins.size(); ++i) mBins[i] += h.mBins[i];
+	if (mSums.size() == h.mSums.size()) {
+		for (size_t i=0; i<mSums.size(); ++i) mSums[i] += h.mSums[i];
+	}
+	mTotal += h.mTotal;
+}
+
+void Histogram::foldBins(const gif::Vector<uint32_t> &counts) {
+	const uint32_t*			src = counts.data();
+	for (size_t i=0; i<mBins.size(); ++i) mBins[i] += src[i];
+}
+
+void Histogram::addRows(const gif::BitmapView &bm, const int32_t top, const int32_t bottom, uint32_t *bins, uint64_t *sums) const {
+	if (sums) {
+		for (int32_t y=top; y<bottom; y+=mSubsample) {
+			const gif::ColorA8u*	row = bm.row(y);
+			for (int32_t x=0; x<bm.mWidth; ++x) {
+				const size_t		bin = binOf(row[x]);
+				uint64_t*			sum = sums + bin * 3;
+				++bins[bin];
+				sum[0] += row[x].r;
+				sum[1] += row[x].g;
+				sum[2] += row[x].b;
+			}
+		}
+		return;
+	}
+	const auto				fn = gif::kernels().mHistogramRow;
+	for (int32_t y=top; y<bottom; y+=mSubsample) {
+		fn(bm.row(y), static_cast<size_t>(bm.mWidth), mBits, bins);
+	}
+}
+
+/**
+ * @class gif::ExactColors
+ */
+ExactColors::ExactColors(const size_t limit, gif::MemoryResource *r)
+		: mLimit(limit)
+		, mKeys(gif::Allocator<uint32_t>(r))
+		, mCounts(gif::Allocator<uint64_t>(r)) {
+	// At most half full, so probes stay short
+	uint32_t				bits = 4;
+	while ((size_t(1) << bits) < (limit + 1) * 2) ++bits;
+	mShift = 32 - bits;
+	mKeys.assign(size_t(1) << bits, EMPTY);
+	mCounts.assign(size_t(1) << bits, 0);
+}
+
+void ExactColors::clear() {
+	std::fill(mKeys.begin(), mKeys.end(), EMPTY);
+	std::fill(mCounts.begin(), mCounts.end(), 0);
+	mSize = 0;
+	mOverflowed = false;
+}
+
+void ExactColors::add(const gif::BitmapView &bm) {
+	for (int32_t y=0; y<bm.mHeight; ++y) {
+		if (mOverflowed) return;
+		const gif::ColorA8u*	row = bm.row(y);
+		int32_t					x = 0;
+		while (x < bm.mWidth) {
+			const uint32_t		key = (static_cast<uint32_t>(row[x].r) << 16) | (static_cast<uint32_t>(row[x].g) << 8) | row[x].b;
+			int32_t				end = x + 1;
+			while (end < bm.mWidth && row[end].r == row[x].r && row[end].g == row[x].g && row[end].b == row[x].b) ++end;
+			if (!insert(key, static_cast<uint64_t>(end - x))) {
+				mOverflowed = true;
+				return;
+			}
+			x = end;
+		}
+	}
+}
+
+bool ExactColors::finish(const size_t max_size, gif::Palette &out) const {
+	if (mOverflowed || mSize > max_size) return false;
+
+	// Most used first, ties going to the lower color so the order is stable.
+	using Counter = std::pair<uint64_t, uint32_t>;
+	gif::Vector<Counter>	used;
+	used.reserve(mSize);
+	for (size_t k=0; k<mKeys.size(); ++k) {
+		if (mKeys[k] != EMPTY) used.push_back(Counter(mCounts[k], mKeys[k]));
+	}
+	std::sort(used.begin(), used.end(), [](const Counter &a, const Counter &b)->bool{ return a.first > b.first || (a.first == b.first && a.second < b.second); });
+	out.mColors.clear();
+	out.mColors.reserve(used.size());
+	for (const auto& c : used) {
+		out.mColors.push_back(gif::ColorA8u(	static_cast<uint8_t>(c.second >> 16),
+												static_cast<uint8_t>(c.second >> 8),
+												static_cast<uint8_t>(c.second), 255));
+	}
+	return true;
+}
+
+bool ExactColors::insert(const uint32_t key, const uint64_t count) {
+	const size_t			mask = mKeys.size() - 1;
+	size_t					i = static_cast<size_t>((key * 0x9e3779b1u) >> mShift);
+	while (mKeys[i] != EMPTY) {
+		if (mKeys[i] == key) {
+			mCounts[i] += count;
+			return true;
+		}
+		i = (i + 1) & mask;
+	}
+	if (mSize >= mLimit) return false;
+	mKeys[i] = key;
+	mCounts[i] = count;
+	++mSize;
+	return true;
+}
+
+} // namespace gif
@@ -0,0 +1,132 @@
+#ifndef GIFWRAP_GIFHISTOGRAM_H_
+#define GIFWRAP_GIFHISTOGRAM_H_
+
+#include <cstdint>
+#include <memory>
+#include "gif_bitmap.h"
+#include "gif_thread.h"
+
+namespace gif {
+
+/**
+ * @class gif::Histogram
+ * @brief Count colors into a flat table of reduced-precision RGB bins.
+ * @description A bin is indexed directly by the top bits of r, g and b, so
+ * counting is one increment a pixel. That goes through the CPU dispatched
+ * kernel, but an increment is a scatter, so the kernel is scalar at every
+ * level. Alpha is ignored. Optionally, the r, g and b of the pixels in each
+ * bin are totalled in the same (also scalar) pass. With threads, the rows
+ * are split into bands that are counted into separate sub-histograms and
+ * then summed, so there's no contention. Each bitmap is counted into 32 bit tables that are
+ * folded into 64 bit totals, so a bin can't overflow however many are added.
+ */
+class Histogram {
+public:
+	Histogram() = delete;
+	Histogram(const Histogram&) = delete;
+	// @param bits is the precision of each channel, 1 to 8. Memory is 12 << (3*bits) bytes,
+	// plus 4 << (3*bits) for each extra thread.
+	// Bins draw from the memory resource r (nullptr for the default).
+	Histogram(const uint32_t bits, gif::MemoryResource *r = nullptr);
+	~Histogram();
+
+	// Only count every step rows. 1 (the default) counts everything.
+	Histogram&					setSubsample(const int32_t step);
+	// Count in parallel bands on this many threads. 0 (the default) counts on the caller.
+	Histogram&					setThreads(const size_t threads);
+	// Also total the channels of each bin, see sums(). Counting then skips the
+	// CPU dispatched kernel. Clears me.
+	Histogram&					setChannelSums(const bool v);
+
+	uint32_t					bits() const { return mBits; }
+	int32_t						subsample() const { return mSubsample; }
+	size_t						binCount() const { return mBins.size(); }
+	const gif::Vector<uint64_t>&
+								bins() const { return mBins; }
+	// With setChannelSums(), the r, g and b totals of each bin, 3 a bin. Otherwise empty.
+	const gif::Vector<uint64_t>&
+								sums() const { return mSums; }
+	// The number of pixels counted since the last clear().
+	uint64_t					total() const { return mTotal; }
+
+	size_t						binOf(const gif::ColorA8u &c) const {
+		const uint32_t			shift = 8 - mBits;
+		return	(static_cast<size_t>(c.r >> shift) << (2 * mBits)) |
+				(static_cast<size_t>(c.g >> shift) << mBits) |
+				static_cast<size_t>(c.b >> shift);
+	}
+	// The color at the center of the bin.
+	gif::ColorA8u				colorOf(const size_t bin) const;
+
+	void						clear();
+	// Add the (subsampled) rows of the bitmap to the counts.
+	void						add(const gif::BitmapView&);
+	// Add the counts of another histogram with the same bits.
+	void						merge(const Histogram&);
+
+private:
+	// sums is nullptr unless channel sums are on.
+	void						addRows(const gif::BitmapView&, const int32_t top, const int32_t bottom, uint32_t *bins, uint64_t *sums) const;
+	// Add one bitmap's counts into the totals.
+	void						foldBins(const gif::Vector<uint32_t>&);
+
+	const uint32_t				mBits;
+	int32_t						mSubsample = 1;
+	gif::MemoryResource*		mResource;
+	gif::Vector<uint64_t>		mBins;
+	gif::Vector<uint64_t>		mSums;
+	uint64_t					mTotal = 0;
+	// One set of counts for each band, and sums for each band but the first, which
+	// sums straight into mSums.
+	gif::Vector<gif::Vector<uint32_t>>
+								mBandBins;
+	gif::Vector<gif::Vector<uint64_t>>
+								mBandSums;
+	// Last, so it's torn down before the band tables its jobs count into.
+	std::unique_ptr<gif::ThreadPool>
+								mPool;
+};
+
+/**
+ * @class gif::ExactColors
+ * @brief Count the distinct colors of a source exactly, while there are few enough.
+ * @description Colors go into a small open addressed table, a lookup for
+ * each run of one color. Once there are more than the limit, counting stops
+ * for good, so a source with many colors only costs the pixels it takes to
+ * find them. Alpha is ignored.
+ */
+class ExactColors {
+public:
+	ExactColors(const ExactColors&) = delete;
+	// @param limit is the most distinct colors counted.
+	// The table draws from the memory resource r (nullptr for the default).
+	ExactColors(const size_t limit = 256, gif::MemoryResource *r = nullptr);
+
+	// Answer true once there have been more colors than the limit.
+	bool						overflowed() const { return mOverflowed; }
+	size_t						size() const { return mSize; }
+
+	void						clear();
+	void						add(const gif::BitmapView&);
+	// If there were no more than max_size colors, set out to every one, most
+	// used first, and answer true. Otherwise answer false and leave out alone.
+	bool						finish(const size_t max_size, gif::Palette &out) const;
+
+private:
+	ExactColors&				operator=(const ExactColors&) = delete;
+
+	// Answer false if key is new and there's no room for it.
+	bool						insert(const uint32_t key, const uint64_t count);
+
+	const size_t				mLimit;
+	uint32_t					mShift;
+	size_t						mSize = 0;
+	bool						mOverflowed = false;
+	// Packed rgb, or all ones where unused, and the count of each
+	gif::Vector<uint32_t>		mKeys;
+	gif::Vector<uint64_t>		mCounts;
+};
+
+} // namespace gif
+
+#endif
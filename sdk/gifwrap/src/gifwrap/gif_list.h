@@ -1,11 +1,37 @@
 #ifndef GIFWRAP_GIFLIST_H_
 #define GIFWRAP_GIFLIST_H_
 
+#include <algorithm>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "gif_bitmap.h"
+#include "gif_hash.h"
+#include "gif_thread.h"
 
 namespace gif {
 
+/**
+ * @class gif::BandAssembler
+ * @brief Collect the bands from ListConstructor::addFrameBand() into whole frames.
+ * @description For consumers that need the whole frame anyway. I hold a full
+ * frame, so this gives up the memory bound that tiling provides.
+ */
+class BandAssembler {
+public:
+	BandAssembler(gif::MemoryResource *r = nullptr) : mFrame(r) { }
+
+	// Copy the band in. Answer true when it completes the frame, which is then in frame().
+	bool					add(const gif::BitmapView &band, const int32_t top, const int32_t frame_height);
+	const gif::Bitmap&		frame() const { return mFrame; }
+	// Release the frame's memory.
+	void					clear();
+
+private:
+	gif::Bitmap				mFrame;
+};
+
 /**
  * @class gif::ListConstructor
  * @brief A stub class passed to the framework for constructing lists.
@@ -15,54 +41,239 @@ public:
 	ListConstructor() { }
 	virtual ~ListConstructor() { }
 
-	virtual void			addFrame(const gif::Bitmap&, const double delay) = 0;
+	// Called by the reader before any frames are added with the number of
+	// image blocks in the file, so storage can be allocated up front.
+	virtual void			reserveFrames(const size_t) { }
+	// The frame is only valid for the duration of the call; the reader reuses
+	// its memory. Rows are not necessarily packed, so use the view's stride.
+	virtual void			addFrame(const gif::BitmapView&, const double delay) = 0;
+	// Used instead of addFrame() when the reader is decoding into a tiled canvas
+	// (see Reader::setTiled()): each frame arrives as consecutive bands of rows, band
+	// being the full frame width and top its first row. The last band of a frame
+	// reaches frame_height. Consume the bands with bounded memory, or collect them
+	// with a gif::BandAssembler if the whole frame is really needed.
+	virtual void			addFrameBand(	const gif::BitmapView &band, const int32_t top,
+											const int32_t frame_height, const double delay) = 0;
 	// Called when the if reader is done reading frames, so
 	// any resources can be cleaned up.
 	virtual void			readerFinished() { }
 };
 
 /**
- * @class gif::GifList
- * @brief Templated class that defines a collection of image frames.
- * @description Clients will subclass and specialize to provide both a
- * local bitmap storage format as T as well as an allocator that translates
- * gif bitmaps into the local storage class.
+ * gif::BandAssembler IMPLEMENTATION
+ */
+inline bool BandAssembler::add(const gif::BitmapView &band, const int32_t top, const int32_t frame_height) {
+	if (band.empty()) return false;
+	mFrame.setTo(band.mWidth, frame_height);
+	if (mFrame.empty() || top < 0 || top + band.mHeight > frame_height) return false;
+	for (int32_t y=0; y<band.mHeight; ++y) {
+		std::copy(band.row(y), band.row(y) + band.mWidth, mFrame.mPixels.begin() + static_cast<size_t>(top + y) * static_cast<size_t>(band.mWidth));
+	}
+	return top + band.mHeight >= frame_height;
+}
+
+inline void BandAssembler::clear() {
+	gif::Vector<gif::ColorA8u>(mFrame.mPixels.get_allocator()).swap(mFrame.mPixels);
+	mFrame.mWidth = mFrame.mHeight = 0;
+}
+
+/**
+ * @class gif::Animation
+ * @brief An immutable sequence of finished frames.
+ * @description Published from a gif::List once reading is done. Clients
+ * hold it through an AnimationRef, so a single decode can be shared by
+ * any number of views and threads without copying the frames.
  */
 template <typename T>
-class List : public gif::ListConstructor {
+class Animation {
 public:
 	class Frame {
 	public:
 		Frame() { }
+		Frame(T &&bitmap, const double delay) : mBitmap(std::move(bitmap)), mDelay(delay) { }
 
 		T							mBitmap;
 		double						mDelay = 0.0;
 	};
 
 public:
-	List(const std::function<T(const gif::Bitmap&)>& alloc = nullptr) : mAlloc(alloc) { }
+	Animation() { }
+	explicit Animation(gif::Vector<Frame> &&frames) : mFrames(std::move(frames)) { }
+
+	bool							empty() const { return mFrames.empty(); }
+	size_t							size() const { return mFrames.size(); }
+	const Frame*					getFrame(const size_t index) const {
+		if (index >= mFrames.size()) return nullptr;
+		return &mFrames[index];
+	}
+
+private:
+	Animation(const Animation&) = delete;
+	Animation&						operator=(const Animation&) = delete;
+
+	const gif::Vector<Frame>		mFrames;
+};
+
+template <typename T>
+using AnimationRef = std::shared_ptr<const gif::Animation<T>>;
+
+/**
+ * @class gif::GifList
+ * @brief Templated class that defines a collection of image frames.
+ * @description Clients will subclass and specialize to provide both a
+ * local bitmap storage format as T as well as an allocator that translates
+ * gif bitmaps into the local storage class.
+ */
+template <typename T>
+class List : public gif::ListConstructor {
+public:
+	using Frame = typename gif::Animation<T>::Frame;
+	// Builds a T over the bands of a frame, see setBandAlloc().
+	using BandAlloc = std::function<void(T&, const gif::BitmapView &band, const int32_t top, const int32_t frame_height)>;
+
+public:
+	// The frame storage and scratch buffers draw from the memory resource r (nullptr
+	// for the default). A published animation still refers to it, so r must outlive that too.
+	// r is only used on the calling thread, so it needn't be thread safe.
+	List(	const std::function<T(const gif::BitmapView&)>& alloc = nullptr,
+			gif::MemoryResource *r = nullptr)
+			: mAlloc(alloc), mFrames(r), mResource(r), mUniques(r), mAssembler(r), mPendingCopies(r) { }
 
 	bool							empty() const { return mFrames.empty(); }
 	size_t							size() const { return mFrames.size(); }
+	// The number of frames that were actually run through the allocator.
+	size_t							uniqueSize() const { return mUniqueCount; }
+
+	// Opt-in: fingerprint each incoming frame and, when it's identical to a frame
+	// already in the list, copy that frame's T instead of allocating a new one.
+	// This is only a storage win if T is a handle type (i.e. a shared_ptr) so the
+	// copy shares the underlying data. A copy of each unique frame is held for
+	// verification until readerFinished().
+	List&							setDeduplicate(const bool v) { mDeduplicate = v; return *this; }
+	// Opt-in: run the allocator on worker threads so decoding can continue while
+	// frames are converted. Incoming frames are copied into a bounded queue of
+	// queue_size entries (0 for a default based on the thread count), and results
+	// are stored by frame index, so the final order is unchanged. The allocator
+	// must be safe to call from multiple threads, and frames hold default T's
+	// until readerFinished() (or publish()) collects the results. The workers
+	// touch the queued copies and results, so those use the default memory
+	// resource rather than the one I was given.
+	// Set threads to 0 to turn conversion back to synchronous.
+	List&							setConversionThreads(const size_t threads, const size_t queue_size = 0);
+	// The allocator for frames that arrive in bands, when the reader tiles a huge screen.
+	// It's called on each band in order, with t default constructed at the start of each
+	// frame, and t is added to the list after the last band, so a T can be built without
+	// ever holding the whole frame. Band frames are never deduplicated or converted on
+	// threads. If not set, the bands are assembled into a whole frame for the regular allocator.
+	List&							setBandAlloc(const BandAlloc &fn) { mBandAlloc = fn; return *this; }
 
-	void							addFrame(const gif::Bitmap&, const double delay) override;
+	void							reserveFrames(const size_t count) override { mFrames.reserve(count); }
+	void							addFrame(const gif::BitmapView&, const double delay) override;
+	void							addFrameBand(	const gif::BitmapView &band, const int32_t top,
+													const int32_t frame_height, const double delay) override;
+	void							readerFinished() override;
 	const Frame*					getFrame(const size_t index) const;
 
+	// Move all frames into an immutable, shareable animation. I am empty afterwards,
+	// and deduplication starts over.
+	AnimationRef<T>					publish();
+
 protected:
-	std::function<T(const gif::Bitmap&)>
+	std::function<T(const gif::BitmapView&)>
 									mAlloc;
-	std::vector<Frame>				mFrames;
+	BandAlloc						mBandAlloc;
+	gif::Vector<Frame>				mFrames;
+
+private:
+	// Answer the frame index of a previous frame with identical pixels, or -1.
+	int64_t							findDuplicate(const gif::BitmapView&);
+	void							convertAsync(const gif::BitmapView&, const size_t index);
+	// Wait on any outstanding conversions and move the results into their frames.
+	void							finishConversion();
+
+	gif::MemoryResource*			mResource;
+	bool							mDeduplicate = false;
+	size_t							mUniqueCount = 0;
+	// Pixel hash to an index into mUniques.
+	std::unordered_multimap<uint64_t, size_t>
+									mHashes;
+	// The source pixels and frame index of each unique frame, for verifying hash matches.
+	gif::Vector<std::pair<gif::Bitmap, size_t>>
+									mUniques;
+	// The frame being built from bands
+	T								mBandFrame;
+	gif::BandAssembler				mAssembler;
+
+	// Asynchronous conversion. The mutex guards the results and the scratch bitmaps,
+	// which the workers allocate into, so they're on the default resource.
+	std::mutex						mConvertMutex;
+	gif::Vector<std::pair<size_t, T>>
+									mConverted;
+	gif::Vector<std::shared_ptr<gif::Bitmap>>
+									mScratch;
+	// Duplicates of frames that haven't been converted yet, as (frame, source frame).
+	gif::Vector<std::pair<size_t, size_t>>
+									mPendingCopies;
+	// Queued conversions store into mConverted, so the pool has to go first.
+	std::unique_ptr<gif::ThreadPool>
+									mPool;
 };
 
 /**
  * gif::List IMPLEMENTATION
  */
 template <typename T>
-void List<T>::addFrame(const gif::Bitmap &bm, const double delay) {
-	mFrames.push_back(Frame());
-	Frame&			f(mFrames.back());
-	if (mAlloc) f.mBitmap = mAlloc(bm);
-	f.mDelay = delay;
+void List<T>::addFrame(const gif::BitmapView &bm, const double delay) {
+	const int64_t	dup = (mDeduplicate ? findDuplicate(bm) : -1);
+	if (dup >= 0) {
+		if (mPool) {
+			// The source might still be converting, so resolve the copy later.
+			mPendingCopies.push_back(std::make_pair(mFrames.size(), static_cast<size_t>(dup)));
+			mFrames.emplace_back(T(), delay);
+		} else {
+			// Copy first, the emplace might reallocate out from under the source.
+			T		t(mFrames[static_cast<size_t>(dup)].mBitmap);
+			mFrames.emplace_back(std::move(t), delay);
+		}
+	} else if (mPool) {
+		convertAsync(bm, mFrames.size());
+		mFrames.emplace_back(T(), delay);
+		++mUniqueCount;
+	} else {
+		mFrames.emplace_back(mAlloc ? mAlloc(bm) : T(), delay);
+		++mUniqueCount;
+	}
+}
+
+template <typename T>
+void List<T>::addFrameBand(const gif::BitmapView &band, const int32_t top, const int32_t frame_height, const double delay) {
+	if (!mBandAlloc) {
+		if (mAssembler.add(band, top, frame_height)) addFrame(mAssembler.frame(), delay);
+		return;
+	}
+	mBandAlloc(mBandFrame, band, top, frame_height);
+	if (top + band.mHeight >= frame_height) {
+		mFrames.emplace_back(std::move(mBandFrame), delay);
+		mBandFrame = T();
+		++mUniqueCount;
+	}
+}
+
+template <typename T>
+List<T>& List<T>::setConversionThreads(const size_t threads, const size_t queue_size) {
+	finishConversion();
+	mPool.reset();
+	if (threads > 0) mPool.reset(new gif::ThreadPool(threads, queue_size));
+	return *this;
+}
+
+template <typename T>
+void List<T>::readerFinished() {
+	finishConversion();
+	mHashes.clear();
+	mUniques.clear();
+	mBandFrame = T();
+	mAssembler.clear();
 }
 
 template <typename T>
@@ -71,6 +282,75 @@ const typename List<T>::Frame* List<T>::getFrame(const size_t index) const {
 	return &mFrames[index];
 }
 
+template <typename T>
+AnimationRef<T> List<T>::publish() {
+	finishConversion();
+	auto			ans = std::make_shared<const gif::Animation<T>>(std::move(mFrames));
+	mFrames.clear();
+	// The unique frames refer to indexes in the frames that were just moved out.
+	mHashes.clear();
+	mUniques.clear();
+	mUniqueCount = 0;
+	return ans;
+}
+
+template <typename T>
+int64_t List<T>::findDuplicate(const gif::BitmapView &bm) {
+	const uint64_t	hash = gif::hash64(bm);
+	auto			range = mHashes.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		const auto&	u = mUniques[it->second];
+		if (gif::BitmapView(u.first) == bm) {
+			return static_cast<int64_t>(u.second);
+		}
+	}
+	// New frame, it will be appended at the current end of the list.
+	mHashes.insert(std::make_pair(hash, mUniques.size()));
+	mUniques.push_back(std::make_pair(gif::Bitmap(mResource), mFrames.size()));
+	mUniques.back().first.copyFrom(bm);
+	return -1;
+}
+
+template <typename T>
+void List<T>::convertAsync(const gif::BitmapView &bm, const size_t index) {
+	// The reader reuses its bitmap, so take a copy, recycling a finished one when possible.
+	std::shared_ptr<gif::Bitmap>	src;
+	{
+		std::lock_guard<std::mutex>	lock(mConvertMutex);
+		if (!mScratch.empty()) {
+			src = mScratch.back();
+			mScratch.pop_back();
+		}
+	}
+	if (!src) src = std::make_shared<gif::Bitmap>();
+	src->copyFrom(bm);
+
+	// Blocks while the queue is full
+	mPool->add([this, src, index]() {
+		T							t(mAlloc ? mAlloc(*src) : T());
+		std::lock_guard<std::mutex>	lock(mConvertMutex);
+		mConverted.push_back(std::make_pair(index, std::move(t)));
+		mScratch.push_back(src);
+	});
+}
+
+template <typename T>
+void List<T>::finishConversion() {
+	if (!mPool) return;
+	mPool->wait();
+
+	std::lock_guard<std::mutex>		lock(mConvertMutex);
+	for (auto& it : mConverted) {
+		if (it.first < mFrames.size()) mFrames[it.first].mBitmap = std::move(it.second);
+	}
+	mConverted.clear();
+	for (const auto& it : mPendingCopies) {
+		if (it.first < mFrames.size() && it.second < mFrames.size()) mFrames[it.first].mBitmap = mFrames[it.second].mBitmap;
+	}
+	mPendingCopies.clear();
+	mScratch.clear();
+}
+
 } // namespace gif
 
 #endif
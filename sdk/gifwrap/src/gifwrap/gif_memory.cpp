@@ -0,0 +1,108 @@
+#include "gif_memory.h"
+
+#include <atomic>
+#include <new>
+
+namespace gif {
+
+namespace {
+
+/**
+ * @class NewDeleteResource
+ * @brief operator new and delete. Alignments beyond what new guarantees are
+ * handled by over-allocating and stashing the original pointer in front.
+ */
+class NewDeleteResource : public MemoryResource {
+public:
+	NewDeleteResource() { }
+
+protected:
+	void*				doAllocate(const size_t bytes, const size_t align) override {
+		if (align <= DEFAULT_ALIGN) return ::operator new(bytes);
+
+		uint8_t*		raw = static_cast<uint8_t*>(::operator new(bytes + align + sizeof(void*)));
+		uintptr_t		p = reinterpret_cast<uintptr_t>(raw + sizeof(void*));
+		p = (p + align - 1) & ~static_cast<uintptr_t>(align - 1);
+		reinterpret_cast<void**>(p)[-1] = raw;
+		return reinterpret_cast<void*>(p);
+	}
+
+	void				doDeallocate(void *p, const size_t, const size_t align) override {
+		if (!p) return;
+		if (align <= DEFAULT_ALIGN) ::operator delete(p);
+		else ::operator delete(static_cast<void**>(p)[-1]);
+	}
+
+	bool				doIsEqual(const MemoryResource &o) const override {
+		return dynamic_cast<const NewDeleteResource*>(&o) != nullptr;
+	}
+};
+
+// nullptr means newDeleteResource(). Kept as a plain pointer so it's valid
+// during static initialization.
+std::atomic<MemoryResource*>	DEFAULT_RESOURCE(nullptr);
+
+}
+
+MemoryResource* newDeleteResource() {
+	// Never destroyed, so it outlives any static containers that use it.
+	static NewDeleteResource*	r = new NewDeleteResource();
+	return r;
+}
+
+MemoryResource* getDefaultResource() {
+	MemoryResource*				r = DEFAULT_RESOURCE.load();
+	return r ? r : newDeleteResource();
+}
+
+MemoryResource* setDefaultResource(MemoryResource *r) {
+	MemoryResource*				prev = DEFAULT_RESOURCE.exchange(r);
+	return prev ? prev : newDeleteResource();
+}
+
+/**
+ * @class gif::MonotonicResource
+ */
+MonotonicResource::MonotonicResource(const size_t initial_size, MemoryResource *upstream)
+		: mUpstream(upstream ? upstream : getDefaultResource())
+		, mNextSize(initial_size > 256 ? initial_size : 256) {
+}
+
+MonotonicResource::~MonotonicResource() {
+	release();
+}
+
+void MonotonicResource::release() {
+	while (mChunks) {
+		Chunk*			next = mChunks->mNext;
+		mUpstream->deallocate(mChunks, mChunks->mSize);
+		mChunks = next;
+	}
+	mCurrent = mEnd = nullptr;
+	mCapacity = 0;
+}
+
+void* MonotonicResource::doAllocate(const size_t bytes, const size_t align) {
+	const size_t		a = (align > 0 ? align : 1);
+	uintptr_t			p = (reinterpret_cast<uintptr_t>(mCurrent) + a - 1) & ~static_cast<uintptr_t>(a - 1);
+	if (!mCurrent || p + bytes > reinterpret_cast<uintptr_t>(mEnd)) {
+		// New chunk, geometrically larger and always big enough for this request.
+		const size_t	header = (sizeof(Chunk) + DEFAULT_ALIGN - 1) & ~(DEFAULT_ALIGN - 1);
+		size_t			size = mNextSize;
+		while (size < header + bytes + a) size *= 2;
+		mNextSize = size * 2;
+
+		Chunk*			chunk = static_cast<Chunk*>(mUpstream->allocate(size));
+		chunk->mNext = mChunks;
+		chunk->mSize = size;
+		mChunks = chunk;
+		mCapacity += size;
+		mCurrent = reinterpret_cast<uint8_t*>(chunk) + header;
+		mEnd = reinterpret_cast<uint8_t*>(chunk) + size;
+		p = (reinterpret_cast<uintptr_t>(mCurrent) + a - 1) & ~static_cast<uintptr_t>(a - 1);
+	}
+	mCurrent = reinterpret_cast<uint8_t*>(p + bytes);
+	return reinterpret_cast<void*>(p);
+}
+
+} // namespace gif
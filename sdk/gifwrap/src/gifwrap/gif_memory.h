@@ -0,0 +1,123 @@
+#ifndef GIFWRAP_GIFMEMORY_H_
+#define GIFWRAP_GIFMEMORY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A polymorphic memory resource and the allocator that uses it, modelled on
+ * C++17's std::pmr but usable from C++11. Every gifwrap buffer is a gif::Vector,
+ * so a client can route a whole decode or encode through, say, a
+ * gif::MonotonicResource and release it in one step.
+ */
+
+namespace gif {
+
+/**
+ * @class gif::MemoryResource
+ * @brief Abstract source of raw memory.
+ */
+class MemoryResource {
+public:
+	static const size_t			DEFAULT_ALIGN = 16;
+
+	MemoryResource() { }
+	virtual ~MemoryResource() { }
+
+	void*						allocate(const size_t bytes, const size_t align = DEFAULT_ALIGN) { return doAllocate(bytes, align); }
+	void						deallocate(void *p, const size_t bytes, const size_t align = DEFAULT_ALIGN) { doDeallocate(p, bytes, align); }
+	// Memory from one resource can be freed by the other.
+	bool						isEqual(const MemoryResource &o) const { return this == &o || doIsEqual(o); }
+
+protected:
+	virtual void*				doAllocate(const size_t bytes, const size_t align) = 0;
+	virtual void				doDeallocate(void*, const size_t bytes, const size_t align) = 0;
+	virtual bool				doIsEqual(const MemoryResource&) const { return false; }
+};
+
+// A process-wide resource that uses operator new and delete.
+MemoryResource*					newDeleteResource();
+// The resource used by allocators that aren't given one. Initially newDeleteResource().
+MemoryResource*					getDefaultResource();
+// Answer the previous default. nullptr restores newDeleteResource().
+MemoryResource*					setDefaultResource(MemoryResource*);
+
+/**
+ * @class gif::MonotonicResource
+ * @brief An arena. Allocation bumps a pointer, deallocation does nothing,
+ * and release() returns every chunk to the upstream resource at once.
+ * Not thread safe.
+ */
+class MonotonicResource : public MemoryResource {
+public:
+	MonotonicResource(const MonotonicResource&) = delete;
+	MonotonicResource(const size_t initial_size = 64 * 1024, MemoryResource *upstream = nullptr);
+	~MonotonicResource();
+
+	void						release();
+	// Total bytes currently held from upstream.
+	size_t						capacity() const { return mCapacity; }
+
+protected:
+	void*						doAllocate(const size_t bytes, const size_t align) override;
+	void						doDeallocate(void*, const size_t, const size_t) override { }
+
+private:
+	struct Chunk {
+		Chunk*					mNext;
+		size_t					mSize;
+	};
+
+	MemoryResource*				mUpstream;
+	size_t						mNextSize;
+	Chunk*						mChunks = nullptr;
+	uint8_t						*mCurrent = nullptr,
+								*mEnd = nullptr;
+	size_t						mCapacity = 0;
+};
+
+/**
+ * @class gif::Allocator
+ * @brief A standard allocator that draws from a MemoryResource.
+ * @description Like std::pmr::polymorphic_allocator, the resource does not
+ * propagate on container copy, move assignment or swap, and copy constructed
+ * containers get the default resource.
+ */
+template <typename T>
+class Allocator {
+public:
+	using value_type = T;
+
+	Allocator() : mResource(getDefaultResource()) { }
+	Allocator(MemoryResource *r) : mResource(r ? r : getDefaultResource()) { }
+	template <typename U>
+	Allocator(const Allocator<U> &o) : mResource(o.resource()) { }
+
+	T*							allocate(const size_t n) {
+		return static_cast<T*>(mResource->allocate(n * sizeof(T), std::alignment_of<T>::value));
+	}
+	void						deallocate(T *p, const size_t n) {
+		mResource->deallocate(p, n * sizeof(T), std::alignment_of<T>::value);
+	}
+
+	Allocator					select_on_container_copy_construction() const { return Allocator(); }
+	MemoryResource*				resource() const { return mResource; }
+
+private:
+	MemoryResource*				mResource;
+};
+
+template <typename T, typename U>
+bool operator==(const Allocator<T> &a, const Allocator<U> &b) { return a.resource()->isEqual(*b.resource()); }
+template <typename T, typename U>
+bool operator!=(const Allocator<T> &a, const Allocator<U> &b) { return !(a == b); }
+
+// The container used for every gifwrap buffer.
+template <typename T>
+using Vector = std::vector<T, gif::Allocator<T>>;
+
+} // namespace gif
+
+#endif
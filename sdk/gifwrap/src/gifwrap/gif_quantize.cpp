@@ -0,0 +1,534 @@
+#include "gif_quantize.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace gif {
+
+namespace {
+// No node
+const int32_t			NONE = -1;
+
+// Wu's moment tables have one empty plane at 0 before the 32 bins of each channel
+const int32_t			WU_BITS = 5;
+const int32_t			WU_SIDE = (1 << WU_BITS) + 1;
+const size_t			WU_TABLE_SIZE = WU_SIDE * WU_SIDE * WU_SIDE;
+
+// Below this many samples a band isn't worth a job
+const size_t			MIN_BAND_SAMPLES = 4096;
+
+inline size_t			wu_index(const int32_t r, const int32_t g, const int32_t b) {
+	return static_cast<size_t>((r * WU_SIDE * WU_SIDE) + (g * WU_SIDE) + b);
+}
+}
+
+/**
+ * @class gif::PixelSampler
+ */
+PixelSampler::PixelSampler(const size_t max_samples, gif::MemoryResource *r)
+		: mMaxSamples(std::max<size_t>(max_samples, 2))
+		, mSamples(gif::Allocator<gif::ColorA8u>(r)) {
+}
+
+gif::BitmapView PixelSampler::view() const {
+	if (mSamples.empty()) return gif::BitmapView();
+	return gif::BitmapView(mSamples.data(), static_cast<int32_t>(mSamples.size()), 1, mSamples.size());
+}
+
+void PixelSampler::clear() {
+	mSamples.clear();
+	mStep = 1;
+	mSkip = 0;
+}
+
+void PixelSampler::add(const gif::BitmapView &bm) {
+	const size_t				width = static_cast<size_t>(std::max<int32_t>(bm.mWidth, 0));
+	for (int32_t y=0; y<bm.mHeight; ++y) {
+		const gif::ColorA8u*	row = bm.row(y);
+		size_t					x = mSkip;
+		for (; x<width; x+=mStep) {
+			if (mSamples.size() >= mMaxSamples) {
+				// Thin out: keep the even samples and take half as often
+				size_t			keep = 0;
+				for (size_t k=0; k<mSamples.size(); k+=2) mSamples[keep++] = mSamples[k];
+				mSamples.resize(keep);
+				mStep *= 2;
+			}
+			mSamples.push_back(row[x]);
+		}
+		mSkip = x - width;
+	}
+}
+
+/**
+ * @class gif::OctreeQuantizer
+ */
+OctreeQuantizer::OctreeQuantizer(const size_t max_leaves, gif::MemoryResource *r)
+		: mMaxLeaves(std::max<size_t>(max_leaves, 8))
+		, mNodes(gif::Allocator<Node>(r))
+		, mFree(gif::Allocator<int32_t>(r)) {
+	for (int32_t k=0; k<DEPTH; ++k) mReducible[k] = gif::Vector<int32_t>(gif::Allocator<int32_t>(r));
+	clear();
+}
+
+void OctreeQuantizer::clear() {
+	mNodes.clear();
+	mFree.clear();
+	for (int32_t k=0; k<DEPTH; ++k) mReducible[k].clear();
+	mLeafCount = 0;
+	// The root
+	newNode(0);
+}
+
+void OctreeQuantizer::add(const gif::BitmapView &bm) {
+	int32_t						last_leaf = NONE;
+	gif::ColorA8u				last;
+	for (int32_t y=0; y<bm.mHeight; ++y) {
+		const gif::ColorA8u*	row = bm.row(y);
+		for (int32_t x=0; x<bm.mWidth; ++x) {
+			const gif::ColorA8u&	c = row[x];
+			// Runs of one color skip the walk. A reduce can only turn the leaf's
+			// parent into the leaf, so the cache is dropped when one happens.
+			if (last_leaf == NONE || c.r != last.r || c.g != last.g || c.b != last.b) {
+				last_leaf = insert(c);
+				last = c;
+			}
+			Node&				n = mNodes[last_leaf];
+			n.mR += c.r;
+			n.mG += c.g;
+			n.mB += c.b;
+			++n.mCount;
+			if (mLeafCount > mMaxLeaves) {
+				reduce();
+				last_leaf = NONE;
+			}
+		}
+	}
+}
+
+void OctreeQuantizer::finish(const size_t max_size, gif::Palette &out) {
+	out.mColors.clear();
+	if (max_size < 1) return;
+	while (mLeafCount > max_size) reduce();
+
+	using Counter = std::pair<uint64_t, gif::ColorA8u>;
+	gif::Vector<Counter>		leaves;
+	for (const auto& n : mNodes) {
+		if (!n.mLeaf || n.mCount < 1) continue;
+		const uint64_t			half = n.mCount / 2;
+		leaves.push_back(Counter(n.mCount, gif::ColorA8u(	static_cast<uint8_t>((n.mR + half) / n.mCount),
+															static_cast<uint8_t>((n.mG + half) / n.mCount),
+															static_cast<uint8_t>((n.mB + half) / n.mCount), 255)));
+	}
+	std::stable_sort(leaves.begin(), leaves.end(), [](const Counter &a, const Counter &b)->bool{ return a.first > b.first; });
+	out.mColors.reserve(leaves.size());
+	for (const auto& p : leaves) out.mColors.push_back(p.second);
+}
+
+void OctreeQuantizer::convert(const gif::BitmapView &bm, const size_t max_size, gif::Palette &out) {
+	clear();
+	add(bm);
+	finish(max_size, out);
+}
+
+int32_t OctreeQuantizer::newNode(const int32_t level) {
+	int32_t						index;
+	if (!mFree.empty()) {
+		index = mFree.back();
+		mFree.pop_back();
+		mNodes[index] = Node();
+	} else {
+		index = static_cast<int32_t>(mNodes.size());
+		mNodes.push_back(Node());
+	}
+	Node&						n = mNodes[index];
+	std::fill(n.mChildren, n.mChildren + 8, NONE);
+	if (level >= DEPTH) {
+		n.mLeaf = true;
+		++mLeafCount;
+	}
+	return index;
+}
+
+int32_t OctreeQuantizer::insert(const gif::ColorA8u &c) {
+	int32_t						index = 0;
+	for (int32_t level=0; level<DEPTH; ++level) {
+		if (mNodes[index].mLeaf) return index;
+		const int32_t			shift = 7 - level;
+		const int32_t			child = (((c.r >> shift) & 1) << 2) | (((c.g >> shift) & 1) << 1) | ((c.b >> shift) & 1);
+		int32_t					next = mNodes[index].mChildren[child];
+		if (next == NONE) {
+			// Careful, the new node can move mNodes
+			const bool			first = std::all_of(mNodes[index].mChildren, mNodes[index].mChildren + 8, [](const int32_t i){ return i == NONE; });
+			next = newNode(level + 1);
+			mNodes[index].mChildren[child] = next;
+			if (first) mReducible[level].push_back(index);
+		}
+		index = next;
+	}
+	return index;
+}
+
+void OctreeQuantizer::reduce() {
+	int32_t						level = DEPTH - 1;
+	while (level >= 0 && mReducible[level].empty()) --level;
+	if (level < 0) return;
+
+	const int32_t				index = mReducible[level].back();
+	mReducible[level].pop_back();
+	Node&						n = mNodes[index];
+	for (int32_t k=0; k<8; ++k) {
+		const int32_t			child = n.mChildren[k];
+		if (child == NONE) continue;
+		// Children of a node on the deepest reducible level are always leaves
+		const Node&				c = mNodes[child];
+		n.mR += c.mR;
+		n.mG += c.mG;
+		n.mB += c.mB;
+		n.mCount += c.mCount;
+		mNodes[child].mLeaf = false;
+		mNodes[child].mCount = 0;
+		mFree.push_back(child);
+		--mLeafCount;
+		n.mChildren[k] = NONE;
+	}
+	n.mLeaf = true;
+	++mLeafCount;
+}
+
+/**
+ * @class gif::WuQuantizer
+ */
+WuQuantizer::WuQuantizer(gif::MemoryResource *r)
+		: mHistogram(WU_BITS, r)
+		, mExact(256, r)
+		, mWeight(gif::Allocator<int64_t>(r))
+		, mR(gif::Allocator<int64_t>(r))
+		, mG(gif::Allocator<int64_t>(r))
+		, mB(gif::Allocator<int64_t>(r))
+		, mSquares(gif::Allocator<double>(r)) {
+	mHistogram.setChannelSums(true);
+}
+
+void WuQuantizer::clear() {
+	mHistogram.clear();
+	mExact.clear();
+}
+
+void WuQuantizer::add(const gif::BitmapView &src) {
+	// The channel sums are totalled in the same (banded) pass as the counts
+	if (mHistogram.sums().empty()) mHistogram.setChannelSums(true);
+	mHistogram.add(src);
+	mExact.add(src);
+}
+
+void WuQuantizer::finish(const size_t max_size, gif::Palette &out) {
+	out.mColors.clear();
+	if (mHistogram.total() < 1 || max_size < 1) return;
+	if (mExact.finish(max_size, out)) return;
+
+	buildMoments();
+
+	// Split the box with the most variance until there are enough
+	gif::Vector<Box>			boxes(1);
+	gif::Vector<double>			variances(1, 0.0);
+	boxes[0].mR1 = boxes[0].mG1 = boxes[0].mB1 = WU_SIDE - 1;
+	boxes[0].mVolume = (WU_SIDE - 1) * (WU_SIDE - 1) * (WU_SIDE - 1);
+	size_t						next = 0;
+	while (boxes.size() < max_size) {
+		Box						split;
+		if (cut(boxes[next], split)) {
+			boxes.push_back(split);
+			variances[next] = (boxes[next].mVolume > 1 ? variance(boxes[next]) : 0.0);
+			variances.push_back(split.mVolume > 1 ? variance(split) : 0.0);
+		} else {
+			variances[next] = 0.0;
+		}
+		next = 0;
+		for (size_t k=1; k<variances.size(); ++k) {
+			if (variances[k] > variances[next]) next = k;
+		}
+		if (variances[next] <= 0.0) break;
+	}
+
+	// Each color is the average of the real pixels in its box. Most used first, like the other quantizers.
+	using Counter = std::pair<uint64_t, gif::ColorA8u>;
+	gif::Vector<Counter>		colors;
+	const auto&					bins = mHistogram.bins();
+	const auto&					sums = mHistogram.sums();
+	for (const auto& b : boxes) {
+		uint64_t				r = 0, g = 0, bl = 0, n = 0;
+		for (int32_t ri=b.mR0+1; ri<=b.mR1; ++ri) {
+			for (int32_t gi=b.mG0+1; gi<=b.mG1; ++gi) {
+				for (int32_t bi=b.mB0+1; bi<=b.mB1; ++bi) {
+					const size_t	bin = (static_cast<size_t>(ri-1) << (2 * WU_BITS)) | (static_cast<size_t>(gi-1) << WU_BITS) | static_cast<size_t>(bi-1);
+					if (bins[bin] == 0) continue;
+					const uint64_t*	sum = sums.data() + bin * 3;
+					r += sum[0];
+					g += sum[1];
+					bl += sum[2];
+					n += bins[bin];
+				}
+			}
+		}
+		if (n < 1) continue;
+		colors.push_back(Counter(n, gif::ColorA8u(	static_cast<uint8_t>((r + n / 2) / n),
+													static_cast<uint8_t>((g + n / 2) / n),
+													static_cast<uint8_t>((bl + n / 2) / n), 255)));
+	}
+	std::stable_sort(colors.begin(), colors.end(), [](const Counter &a, const Counter &b)->bool{ return a.first > b.first; });
+	out.mColors.reserve(colors.size());
+	for (const auto& c : colors) out.mColors.push_back(c.second);
+}
+
+void WuQuantizer::convert(const gif::BitmapView &src, const size_t max_size, gif::Palette &out) {
+	clear();
+	add(src);
+	finish(max_size, out);
+}
+
+void WuQuantizer::buildMoments() {
+	mWeight.assign(WU_TABLE_SIZE, 0);
+	mR.assign(WU_TABLE_SIZE, 0);
+	mG.assign(WU_TABLE_SIZE, 0);
+	mB.assign(WU_TABLE_SIZE, 0);
+	mSquares.assign(WU_TABLE_SIZE, 0.0);
+
+	// Raw moments, each bin's pixels at the bin center
+	const auto&					bins = mHistogram.bins();
+	for (size_t k=0; k<bins.size(); ++k) {
+		if (bins[k] == 0) continue;
+		const gif::ColorA8u		c = mHistogram.colorOf(k);
+		const int64_t			n = bins[k];
+		const size_t			i = wu_index(c.r >> 3, c.g >> 3, c.b >> 3) + wu_index(1, 1, 1);
+		mWeight[i] = n;
+		mR[i] = n * c.r;
+		mG[i] = n * c.g;
+		mB[i] = n * c.b;
+		mSquares[i] = static_cast<double>(n) * static_cast<double>(c.r * c.r + c.g * c.g + c.b * c.b);
+	}
+
+	// Accumulate into cumulative moments
+	int64_t						area_w[WU_SIDE], area_r[WU_SIDE], area_g[WU_SIDE], area_b[WU_SIDE];
+	double						area_2[WU_SIDE];
+	for (int32_t r=1; r<WU_SIDE; ++r) {
+		std::memset(area_w, 0, sizeof(area_w));
+		std::memset(area_r, 0, sizeof(area_r));
+		std::memset(area_g, 0, sizeof(area_g));
+		std::memset(area_b, 0, sizeof(area_b));
+		for (int32_t b=0; b<WU_SIDE; ++b) area_2[b] = 0.0;
+		for (int32_t g=1; g<WU_SIDE; ++g) {
+			int64_t				line_w = 0, line_r = 0, line_g = 0, line_b = 0;
+			double				line_2 = 0.0;
+			for (int32_t b=1; b<WU_SIDE; ++b) {
+				const size_t	i = wu_index(r, g, b),
+								prev = wu_index(r-1, g, b);
+				line_w += mWeight[i];
+				line_r += mR[i];
+				line_g += mG[i];
+				line_b += mB[i];
+				line_2 += mSquares[i];
+				area_w[b] += line_w;
+				area_r[b] += line_r;
+				area_g[b] += line_g;
+				area_b[b] += line_b;
+				area_2[b] += line_2;
+				mWeight[i] = mWeight[prev] + area_w[b];
+				mR[i] = mR[prev] + area_r[b];
+				mG[i] = mG[prev] + area_g[b];
+				mB[i] = mB[prev] + area_b[b];
+				mSquares[i] = mSquares[prev] + area_2[b];
+			}
+		}
+	}
+}
+
+template <typename V>
+V WuQuantizer::volume(const Box &c, const gif::Vector<V> &m) const {
+	return	  m[wu_index(c.mR1, c.mG1, c.mB1)] - m[wu_index(c.mR1, c.mG1, c.mB0)]
+			- m[wu_index(c.mR1, c.mG0, c.mB1)] + m[wu_index(c.mR1, c.mG0, c.mB0)]
+			- m[wu_index(c.mR0, c.mG1, c.mB1)] + m[wu_index(c.mR0, c.mG1, c.mB0)]
+			+ m[wu_index(c.mR0, c.mG0, c.mB1)] - m[wu_index(c.mR0, c.mG0, c.mB0)];
+}
+
+template <typename V>
+V WuQuantizer::bottom(const Box &c, const Axis axis, const gif::Vector<V> &m) const {
+	switch (axis) {
+		case Axis::kRed:	return	- m[wu_index(c.mR0, c.mG1, c.mB1)] + m[wu_index(c.mR0, c.mG1, c.mB0)]
+									+ m[wu_index(c.mR0, c.mG0, c.mB1)] - m[wu_index(c.mR0, c.mG0, c.mB0)];
+		case Axis::kGreen:	return	- m[wu_index(c.mR1, c.mG0, c.mB1)] + m[wu_index(c.mR1, c.mG0, c.mB0)]
+									+ m[wu_index(c.mR0, c.mG0, c.mB1)] - m[wu_index(c.mR0, c.mG0, c.mB0)];
+		default:			return	- m[wu_index(c.mR1, c.mG1, c.mB0)] + m[wu_index(c.mR1, c.mG0, c.mB0)]
+									+ m[wu_index(c.mR0, c.mG1, c.mB0)] - m[wu_index(c.mR0, c.mG0, c.mB0)];
+	}
+}
+
+template <typename V>
+V WuQuantizer::top(const Box &c, const Axis axis, const int32_t p, const gif::Vector<V> &m) const {
+	switch (axis) {
+		case Axis::kRed:	return	  m[wu_index(p, c.mG1, c.mB1)] - m[wu_index(p, c.mG1, c.mB0)]
+									- m[wu_index(p, c.mG0, c.mB1)] + m[wu_index(p, c.mG0, c.mB0)];
+		case Axis::kGreen:	return	  m[wu_index(c.mR1, p, c.mB1)] - m[wu_index(c.mR1, p, c.mB0)]
+									- m[wu_index(c.mR0, p, c.mB1)] + m[wu_index(c.mR0, p, c.mB0)];
+		default:			return	  m[wu_index(c.mR1, c.mG1, p)] - m[wu_index(c.mR1, c.mG0, p)]
+									- m[wu_index(c.mR0, c.mG1, p)] + m[wu_index(c.mR0, c.mG0, p)];
+	}
+}
+
+double WuQuantizer::variance(const Box &c) const {
+	const double				r = static_cast<double>(volume(c, mR)),
+								g = static_cast<double>(volume(c, mG)),
+								b = static_cast<double>(volume(c, mB)),
+								w = static_cast<double>(volume(c, mWeight));
+	if (w <= 0.0) return 0.0;
+	return volume(c, mSquares) - ((r * r) + (g * g) + (b * b)) / w;
+}
+
+double WuQuantizer::maximize(	const Box &c, const Axis axis, const int32_t first, const int32_t last, int32_t &cut,
+								const int64_t whole_r, const int64_t whole_g, const int64_t whole_b, const int64_t whole_w) const {
+	const int64_t				base_r = bottom(c, axis, mR),
+								base_g = bottom(c, axis, mG),
+								base_b = bottom(c, axis, mB),
+								base_w = bottom(c, axis, mWeight);
+	double						best = 0.0;
+	cut = -1;
+	for (int32_t i=first; i<last; ++i) {
+		const int64_t			half_r = base_r + top(c, axis, i, mR),
+								half_g = base_g + top(c, axis, i, mG),
+								half_b = base_b + top(c, axis, i, mB),
+								half_w = base_w + top(c, axis, i, mWeight);
+		// Both sides need pixels
+		if (half_w == 0 || half_w == whole_w) continue;
+		const double			lr = static_cast<double>(half_r), lg = static_cast<double>(half_g), lb = static_cast<double>(half_b),
+								hr = static_cast<double>(whole_r - half_r), hg = static_cast<double>(whole_g - half_g), hb = static_cast<double>(whole_b - half_b);
+		const double			score =	((lr * lr) + (lg * lg) + (lb * lb)) / static_cast<double>(half_w) +
+										((hr * hr) + (hg * hg) + (hb * hb)) / static_cast<double>(whole_w - half_w);
+		if (score > best) {
+			best = score;
+			cut = i;
+		}
+	}
+	return best;
+}
+
+bool WuQuantizer::cut(Box &a, Box &b) const {
+	const int64_t				whole_r = volume(a, mR),
+								whole_g = volume(a, mG),
+								whole_b = volume(a, mB),
+								whole_w = volume(a, mWeight);
+	int32_t						cut_r, cut_g, cut_b;
+	const double				max_r = maximize(a, Axis::kRed, a.mR0 + 1, a.mR1, cut_r, whole_r, whole_g, whole_b, whole_w),
+								max_g = maximize(a, Axis::kGreen, a.mG0 + 1, a.mG1, cut_g, whole_r, whole_g, whole_b, whole_w),
+								max_b = maximize(a, Axis::kBlue, a.mB0 + 1, a.mB1, cut_b, whole_r, whole_g, whole_b, whole_w);
+
+	b.mR1 = a.mR1;
+	b.mG1 = a.mG1;
+	b.mB1 = a.mB1;
+	if (max_r >= max_g && max_r >= max_b) {
+		if (cut_r < 0) return false;
+		b.mR0 = a.mR1 = cut_r;
+		b.mG0 = a.mG0;
+		b.mB0 = a.mB0;
+	} else if (max_g >= max_r && max_g >= max_b) {
+		if (cut_g < 0) return false;
+		b.mG0 = a.mG1 = cut_g;
+		b.mR0 = a.mR0;
+		b.mB0 = a.mB0;
+	} else {
+		if (cut_b < 0) return false;
+		b.mB0 = a.mB1 = cut_b;
+		b.mR0 = a.mR0;
+		b.mG0 = a.mG0;
+	}
+	a.mVolume = (a.mR1 - a.mR0) * (a.mG1 - a.mG0) * (a.mB1 - a.mB0);
+	b.mVolume = (b.mR1 - b.mR0) * (b.mG1 - b.mG0) * (b.mB1 - b.mB0);
+	return true;
+}
+
+/**
+ * @class gif::KMeansRefiner
+ */
+KMeansRefiner::KMeansRefiner(const size_t max_iterations, const size_t max_samples)
+		: mMaxIterations(max_iterations)
+		, mMaxSamples(std::max<size_t>(max_samples, 1)) {
+}
+
+KMeansRefiner& KMeansRefiner::setThreads(const size_t threads) {
+	mPool.reset();
+	if (threads > 0) mPool.reset(new gif::ThreadPool(threads));
+	return *this;
+}
+
+size_t KMeansRefiner::refine(const gif::BitmapView &bm, gif::Palette &palette) {
+	if (bm.empty() || palette.empty() || mMaxIterations < 1) return 0;
+
+	// An even grid of samples, counted per axis so a single row (i.e. a
+	// PixelSampler view) is thinned as much as a square image.
+	const auto					samples_at = [&bm](const int32_t step)->size_t {
+		return	static_cast<size_t>((bm.mWidth + step - 1) / step) *
+				static_cast<size_t>((bm.mHeight + step - 1) / step);
+	};
+	int32_t						step = 1;
+	while (samples_at(step) > mMaxSamples) ++step;
+	mSamples.clear();
+	for (int32_t y=0; y<bm.mHeight; y+=step) {
+		const gif::ColorA8u*	row = bm.row(y);
+		for (int32_t x=0; x<bm.mWidth; x+=step) mSamples.push_back(row[x]);
+	}
+	mIndexes.resize(mSamples.size());
+
+	const size_t				colors = std::min<size_t>(palette.size(), 256);
+	const size_t				bands = std::max<size_t>(mPool ? std::min(mPool->size(), mSamples.size() / MIN_BAND_SAMPLES) : 1, 1);
+	const size_t				band_size = (mSamples.size() + bands - 1) / bands;
+	if (mSums.size() < bands) mSums.resize(bands);
+
+	size_t						iteration = 0;
+	while (iteration < mMaxIterations) {
+		++iteration;
+		mPacked.setTo(palette.mColors.data(), colors);
+		for (size_t k=0; k<bands; ++k) mSums[k].assign(colors * 4, 0);
+		for (size_t k=1; k<bands; ++k) {
+			const size_t		begin = k * band_size,
+								end = std::min(begin + band_size, mSamples.size());
+			uint64_t*			sums = mSums[k].data();
+			mPool->add([this, begin, end, sums]() { if (begin < end) assign(begin, end, sums); });
+		}
+		assign(0, std::min(band_size, mSamples.size()), mSums[0].data());
+		if (mPool) mPool->wait();
+
+		bool					moved = false;
+		for (size_t c=0; c<colors; ++c) {
+			uint64_t			r = 0, g = 0, b = 0, n = 0;
+			for (size_t k=0; k<bands; ++k) {
+				const uint64_t*	sum = mSums[k].data() + c * 4;
+				r += sum[0];
+				g += sum[1];
+				b += sum[2];
+				n += sum[3];
+			}
+			if (n < 1) continue;
+			const gif::ColorA8u	mean(	static_cast<uint8_t>((r + n / 2) / n),
+										static_cast<uint8_t>((g + n / 2) / n),
+										static_cast<uint8_t>((b + n / 2) / n), 255);
+			if (!(mean == palette.mColors[c])) {
+				palette.mColors[c] = mean;
+				moved = true;
+			}
+		}
+		if (!moved) break;
+	}
+	return iteration;
+}
+
+void KMeansRefiner::assign(const size_t begin, const size_t end, uint64_t *sums) {
+	gif::kernels().mMatchRow(mSamples.data() + begin, end - begin, mPacked, mIndexes.data() + begin);
+	for (size_t k=begin; k<end; ++k) {
+		uint64_t*				sum = sums + static_cast<size_t>(mIndexes[k]) * 4;
+		sum[0] += mSamples[k].r;
+		sum[1] += mSamples[k].g;
+		sum[2] += mSamples[k].b;
+		sum[3] += 1;
+	}
+}
+
+} // namespace gif
@@ -0,0 +1,240 @@
+#ifndef GIFWRAP_GIFQUANTIZE_H_
+#define GIFWRAP_GIFQUANTIZE_H_
+
+#include <cstdint>
+#include <memory>
+#include "gif_bitmap.h"
+#include "gif_cpu.h"
+#include "gif_histogram.h"
+#include "gif_thread.h"
+
+/**
+ * Quantizers, usable directly as gif::EncoderT policies or through the
+ * BitmapToPalette plug-ins in gif_algorithm.h.
+ */
+
+namespace gif {
+
+/**
+ * @class gif::PixelSampler
+ * @brief Keep an evenly spaced sample of every pixel added, up to a limit.
+ * @description Takes every step pixels in raster order, across bitmaps. When
+ * the sample is full, every other one is dropped and the step doubles, so
+ * the sample stays spread over everything seen.
+ */
+class PixelSampler {
+public:
+	PixelSampler(const size_t max_samples = 1<<20, gif::MemoryResource *r = nullptr);
+
+	size_t						size() const { return mSamples.size(); }
+	// The samples as a single row.
+	gif::BitmapView				view() const;
+
+	void						clear();
+	void						add(const gif::BitmapView&);
+
+private:
+	size_t						mMaxSamples,
+								mStep = 1,
+								// Pixels to pass over before the next sample
+								mSkip = 0;
+	gif::Vector<gif::ColorA8u>	mSamples;
+};
+
+/**
+ * @class gif::OctreeQuantizer
+ * @brief Build a palette by merging colors in an RGB octree.
+ * @description Pixels stream in through add(), one tree walk each, so one
+ * palette can be built from any number of frames without keeping them. The
+ * node memory is bounded: whenever there are more than max_leaves colors, the
+ * most recent node on the deepest level folds its children into itself.
+ * finish() folds further, down to the palette size.
+ */
+class OctreeQuantizer {
+public:
+	OctreeQuantizer(const OctreeQuantizer&) = delete;
+	// Nodes draw from the memory resource r (nullptr for the default).
+	OctreeQuantizer(const size_t max_leaves = 4096, gif::MemoryResource *r = nullptr);
+
+	void						clear();
+	void						add(const gif::BitmapView&);
+	// Reduce to at most max_size colors, most used first. The reduction stays,
+	// so clear() before starting on a new palette.
+	void						finish(const size_t max_size, gif::Palette&);
+
+	// As a quantizer policy, the palette for just this bitmap.
+	void						convert(const gif::BitmapView&, const size_t max_size, gif::Palette&);
+
+	size_t						leafCount() const { return mLeafCount; }
+
+private:
+	OctreeQuantizer&			operator=(const OctreeQuantizer&) = delete;
+
+	static const int32_t		DEPTH = 8;
+
+	struct Node {
+		uint64_t				mR = 0,
+								mG = 0,
+								mB = 0,
+								mCount = 0;
+		int32_t					mChildren[8];
+		bool					mLeaf = false;
+	};
+
+	int32_t						newNode(const int32_t level);
+	// Answer the leaf for c, creating nodes as needed.
+	int32_t						insert(const gif::ColorA8u &c);
+	// Fold the children of the most recent node on the deepest level into it.
+	void						reduce();
+
+	size_t						mMaxLeaves;
+	gif::Vector<Node>			mNodes;
+	gif::Vector<int32_t>		mFree;
+	// Nodes with children, per level, most recent last
+	gif::Vector<int32_t>		mReducible[DEPTH];
+	size_t						mLeafCount = 0;
+};
+
+/**
+ * @class gif::WuQuantizer
+ * @brief Xiaolin Wu's variance minimising quantizer.
+ * @description Pixels are counted into a 5 bit gif::Histogram, from which
+ * 33x33x33 cumulative moment tables are built, so the variance of any box
+ * of colors is a constant time lookup. The box with the most variance is
+ * split where that reduces it most, until there are enough boxes. Each color
+ * is then the average of the pixels in its box. The counts and per bin
+ * channel sums are accumulated in one scalar pass; the histogram's threads
+ * split it into bands, which is where the speed comes from.
+ *
+ * Within a bin, pixels are treated as the bin center when choosing cuts,
+ * but the real pixels are summed per bin as they're added, so the final
+ * averages are exact. Bins would still merge distinct colors, so a source
+ * with no more colors than the palette skips all this and comes through
+ * exactly, from a gif::ExactColors counted alongside.
+ */
+class WuQuantizer {
+public:
+	WuQuantizer(const WuQuantizer&) = delete;
+	// Tables draw from the memory resource r (nullptr for the default).
+	WuQuantizer(gif::MemoryResource *r = nullptr);
+
+	// Configure subsampling and threads here.
+	gif::Histogram&				histogram() { return mHistogram; }
+
+	// Build one palette from many bitmaps.
+	void						clear();
+	void						add(const gif::BitmapView&);
+	void						finish(const size_t max_size, gif::Palette&);
+
+	// The palette for just this bitmap.
+	void						convert(const gif::BitmapView&, const size_t max_size, gif::Palette&);
+
+private:
+	WuQuantizer&				operator=(const WuQuantizer&) = delete;
+
+	// Bounds are exclusive at 0 and inclusive at 1, in table coordinates
+	struct Box {
+		int32_t					mR0 = 0, mR1 = 0,
+								mG0 = 0, mG1 = 0,
+								mB0 = 0, mB1 = 0;
+		int32_t					mVolume = 0;
+	};
+	enum class Axis { kRed, kGreen, kBlue };
+
+	void						buildMoments();
+	template <typename V>
+	V							volume(const Box&, const gif::Vector<V>&) const;
+	template <typename V>
+	V							bottom(const Box&, const Axis, const gif::Vector<V>&) const;
+	template <typename V>
+	V							top(const Box&, const Axis, const int32_t position, const gif::Vector<V>&) const;
+	double						variance(const Box&) const;
+	double						maximize(	const Box&, const Axis, const int32_t first, const int32_t last, int32_t &cut,
+											const int64_t whole_r, const int64_t whole_g, const int64_t whole_b, const int64_t whole_w) const;
+	bool						cut(Box &a, Box &b) const;
+
+	// With channel sums, for the real r, g and b totals of each bin
+	gif::Histogram				mHistogram;
+	gif::ExactColors			mExact;
+	// Cumulative moments: weight, per channel sums, and sum of squares
+	gif::Vector<int64_t>		mWeight,
+								mR,
+								mG,
+								mB;
+	gif::Vector<double>			mSquares;
+};
+
+/**
+ * @class gif::KMeansRefiner
+ * @brief Improve a palette with a few k-means (Lloyd) iterations.
+ * @description Runs over an evenly spaced sample of the pixels. Each
+ * iteration assigns every sample to its nearest color, with the same
+ * distance and kernel the encoder matches with, then moves each color to the
+ * average of its samples. Stops early once no color moves. Colors nothing
+ * was assigned to stay put. With threads, the assignment and sums are split
+ * across the sample.
+ */
+class KMeansRefiner {
+public:
+	KMeansRefiner(const KMeansRefiner&) = delete;
+	KMeansRefiner(const size_t max_iterations = 4, const size_t max_samples = 1<<16);
+
+	KMeansRefiner&				setThreads(const size_t threads);
+
+	// Answer the number of iterations run.
+	size_t						refine(const gif::BitmapView&, gif::Palette&);
+
+private:
+	KMeansRefiner&				operator=(const KMeansRefiner&) = delete;
+
+	// Assign samples [begin, end) and add them into sums (4 per color)
+	void						assign(const size_t begin, const size_t end, uint64_t *sums);
+
+	size_t						mMaxIterations,
+								mMaxSamples;
+	gif::Vector<gif::ColorA8u>	mSamples;
+	gif::Vector<uint8_t>		mIndexes;
+	gif::PackedPalette			mPacked;
+	// One set of sums per band
+	gif::Vector<gif::Vector<uint64_t>>
+								mSums;
+	// Goes before mSamples and mSums, which running jobs assign and sum into.
+	std::unique_ptr<gif::ThreadPool>
+								mPool;
+};
+
+/**
+ * @class gif::KMeansQuantizer
+ * @brief Quantizer policy that refines the palette of another.
+ */
+template <typename Quantizer>
+class KMeansQuantizer {
+public:
+	KMeansQuantizer(const size_t max_iterations = 4, const size_t max_samples = 1<<16)
+			: mRefiner(max_iterations, max_samples) { }
+
+	Quantizer&					source() { return mSource; }
+	KMeansRefiner&				refiner() { return mRefiner; }
+
+	// Build one palette from many bitmaps. The refinement runs over a sample of all of them.
+	void						clear() { mSource.clear(); mSampler.clear(); }
+	void						add(const gif::BitmapView &bm) { mSource.add(bm); mSampler.add(bm); }
+	void						finish(const size_t max_size, gif::Palette &out) {
+		mSource.finish(max_size, out);
+		mRefiner.refine(mSampler.view(), out);
+	}
+
+	void						convert(const gif::BitmapView &bm, const size_t max_size, gif::Palette &out) {
+		mSource.convert(bm, max_size, out);
+		mRefiner.refine(bm, out);
+	}
+
+private:
+	Quantizer					mSource;
+	KMeansRefiner				mRefiner;
+	PixelSampler				mSampler;
+};
+
+} // namespace gif
+
+#endif
@@ -0,0 +1,133 @@
+#include "gif_spool.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace gif {
+
+namespace {
+// Each frame is its delay, width and height, then the packed pixels.
+struct SpoolHeader {
+	double				mDelay;
+	int32_t				mWidth,
+						mHeight;
+};
+}
+
+/**
+ * @class gif::FrameSpool
+ */
+FrameSpool::FrameSpool(gif::MemoryResource *r)
+		: mMemory(gif::Allocator<uint8_t>(r)) {
+}
+
+FrameSpool::~FrameSpool() {
+	closeFile();
+}
+
+void FrameSpool::setPath(const std::string &path) {
+	clear();
+	closeFile();
+	mInMemory = false;
+	mPath = path;
+	if (!path.empty()) openFile();
+}
+
+void FrameSpool::setInMemory() {
+	clear();
+	closeFile();
+	mInMemory = true;
+	mPath.clear();
+}
+
+void FrameSpool::clear() {
+	gif::Vector<uint8_t>(mMemory.get_allocator()).swap(mMemory);
+	mCount = 0;
+	mReading = false;
+	if (!mFile) return;
+	// A temporary file is simply recreated, which gives back the disk space.
+	if (mPath.empty()) closeFile();
+	else std::fseek(mFile, 0, SEEK_SET);
+}
+
+void FrameSpool::add(const gif::BitmapView &bm, const double delay) {
+	if (mReading) {
+		// Back to appending after the last frame
+		mReading = false;
+		if (mFile) std::fseek(mFile, 0, SEEK_END);
+	}
+	openFile();
+
+	SpoolHeader					header;
+	header.mDelay = delay;
+	header.mWidth = (bm.empty() ? 0 : bm.mWidth);
+	header.mHeight = (bm.empty() ? 0 : bm.mHeight);
+	const size_t				row_bytes = static_cast<size_t>(header.mWidth) * sizeof(gif::ColorA8u);
+	if (mFile) {
+		bool					ok = std::fwrite(&header, sizeof(header), 1, mFile) == 1;
+		for (int32_t y=0; ok && y<header.mHeight; ++y) {
+			ok = std::fwrite(bm.row(y), 1, row_bytes, mFile) == row_bytes;
+		}
+		if (!ok) throw std::runtime_error("FrameSpool failed writing " + (mPath.empty() ? std::string("temporary file") : mPath));
+	} else {
+		size_t					offset = mMemory.size();
+		mMemory.resize(offset + sizeof(header) + row_bytes * static_cast<size_t>(header.mHeight));
+		std::memcpy(mMemory.data() + offset, &header, sizeof(header));
+		offset += sizeof(header);
+		for (int32_t y=0; y<header.mHeight; ++y, offset+=row_bytes) {
+			std::memcpy(mMemory.data() + offset, bm.row(y), row_bytes);
+		}
+	}
+	++mCount;
+}
+
+void FrameSpool::rewind() {
+	mReading = true;
+	mReadCount = 0;
+	mReadOffset = 0;
+	if (mFile) {
+		std::fflush(mFile);
+		std::fseek(mFile, 0, SEEK_SET);
+	}
+}
+
+bool FrameSpool::next(gif::Bitmap &bm, double &delay) {
+	if (!mReading) rewind();
+	if (mReadCount >= mCount) return false;
+
+	SpoolHeader					header;
+	if (mFile) {
+		bool					ok = std::fread(&header, sizeof(header), 1, mFile) == 1;
+		if (ok) {
+			bm.setTo(header.mWidth, header.mHeight);
+			if (!bm.empty()) ok = std::fread(bm.mPixels.data(), sizeof(gif::ColorA8u), bm.mPixels.size(), mFile) == bm.mPixels.size();
+		}
+		if (!ok) throw std::runtime_error("FrameSpool failed reading " + (mPath.empty() ? std::string("temporary file") : mPath));
+	} else {
+		std::memcpy(&header, mMemory.data() + mReadOffset, sizeof(header));
+		mReadOffset += sizeof(header);
+		bm.setTo(header.mWidth, header.mHeight);
+		if (!bm.empty()) std::memcpy(bm.mPixels.data(), mMemory.data() + mReadOffset, bm.mPixels.size() * sizeof(gif::ColorA8u));
+		mReadOffset += bm.mPixels.size() * sizeof(gif::ColorA8u);
+	}
+	delay = header.mDelay;
+	++mReadCount;
+	return true;
+}
+
+void FrameSpool::openFile() {
+	if (mInMemory || mFile) return;
+	// A temporary file deletes itself when closed
+	mFile = (mPath.empty() ? std::tmpfile() : std::fopen(mPath.c_str(), "w+b"));
+	if (!mFile) throw std::runtime_error("FrameSpool can't open " + (mPath.empty() ? std::string("a temporary file") : mPath));
+}
+
+void FrameSpool::closeFile() {
+	if (!mFile) return;
+	std::fclose(mFile);
+	mFile = nullptr;
+	if (!mPath.empty()) std::remove(mPath.c_str());
+}
+
+} // namespace gif
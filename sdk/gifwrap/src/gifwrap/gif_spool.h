@@ -0,0 +1,62 @@
+#ifndef GIFWRAP_GIFSPOOL_H_
+#define GIFWRAP_GIFSPOOL_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "gif_bitmap.h"
+
+namespace gif {
+
+/**
+ * @class gif::FrameSpool
+ * @brief Hold RGBA frames for a second pass, in a file or in memory.
+ * @description Frames are appended packed, then read back in order. With a
+ * file (the default), memory use is one frame no matter how many are spooled.
+ */
+class FrameSpool {
+public:
+	FrameSpool(const FrameSpool&) = delete;
+	// The memory buffer draws from the memory resource r (nullptr for the default).
+	FrameSpool(gif::MemoryResource *r = nullptr);
+	~FrameSpool();
+
+	// Spool to the file at path, which is created and then deleted when I'm
+	// destroyed or given another path. An empty path (the default) spools to an
+	// anonymous temporary file, created on the first add().
+	// Throw if the file can't be opened. Drops anything already spooled.
+	void						setPath(const std::string &path);
+	// Spool in memory instead, which saves the file traffic but grows with every
+	// frame. Drops anything already spooled.
+	void						setInMemory();
+
+	size_t						size() const { return mCount; }
+	void						clear();
+
+	// Append the frame and its delay. Throw on a file error.
+	void						add(const gif::BitmapView&, const double delay = 0.0);
+	// Start reading from the first frame.
+	void						rewind();
+	// Read the next frame into bm and its delay. Answer false at the end. Throw on a file error.
+	bool						next(gif::Bitmap &bm, double &delay);
+
+private:
+	FrameSpool&					operator=(const FrameSpool&) = delete;
+
+	// Open the file, if I spool to one and it isn't open. Throw on error.
+	void						openFile();
+	void						closeFile();
+
+	bool						mInMemory = false;
+	std::string					mPath;
+	std::FILE*					mFile = nullptr;
+	gif::Vector<uint8_t>		mMemory;
+	size_t						mCount = 0,
+								mReadCount = 0,
+								mReadOffset = 0;
+	bool						mReading = false;
+};
+
+} // namespace gif
+
+#endif
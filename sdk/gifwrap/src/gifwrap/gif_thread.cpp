@@ -0,0 +1,80 @@
+#include "gif_thread.h"
+
+namespace gif {
+
+/**
+ * @class gif::ThreadPool
+ */
+ThreadPool::ThreadPool(const size_t threads, const size_t max_queued) {
+	const size_t		count = (threads > 0 ? threads : hardwareThreads());
+	mMaxQueued = (max_queued > 0 ? max_queued : count * 2);
+	mThreads.reserve(count);
+	for (size_t k=0; k<count; ++k) {
+		mThreads.push_back(std::thread([this](){ run(); }));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex>	lock(mMutex);
+		mQuit = true;
+	}
+	mJobAdded.notify_all();
+	for (auto& t : mThreads) {
+		if (t.joinable()) t.join();
+	}
+}
+
+void ThreadPool::add(const std::function<void(void)> &fn) {
+	if (!fn) return;
+	std::unique_lock<std::mutex>	lock(mMutex);
+	mJobTaken.wait(lock, [this]()->bool{ return mJobs.size() < mMaxQueued; });
+	mJobs.push_back(fn);
+	lock.unlock();
+	mJobAdded.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex>	lock(mMutex);
+	mJobDone.wait(lock, [this]()->bool{ return mJobs.empty() && mActive == 0; });
+	if (mError) {
+		std::exception_ptr			err = mError;
+		mError = nullptr;
+		std::rethrow_exception(err);
+	}
+}
+
+size_t ThreadPool::hardwareThreads() {
+	const size_t		count = static_cast<size_t>(std::thread::hardware_concurrency());
+	return (count > 0 ? count : 1);
+}
+
+void ThreadPool::run() {
+	while (true) {
+		std::function<void(void)>	fn;
+		{
+			std::unique_lock<std::mutex>	lock(mMutex);
+			mJobAdded.wait(lock, [this]()->bool{ return mQuit || !mJobs.empty(); });
+			if (mJobs.empty()) return;
+			fn = std::move(mJobs.front());
+			mJobs.pop_front();
+			++mActive;
+		}
+		mJobTaken.notify_one();
+
+		try {
+			fn();
+		} catch (...) {
+			std::lock_guard<std::mutex>	lock(mMutex);
+			if (!mError) mError = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex>	lock(mMutex);
+			--mActive;
+		}
+		mJobDone.notify_all();
+	}
+}
+
+} // namespace gif
@@ -0,0 +1,58 @@
+#ifndef GIFWRAP_GIFTHREAD_H_
+#define GIFWRAP_GIFTHREAD_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gif {
+
+/**
+ * @class gif::ThreadPool
+ * @brief A fixed set of worker threads pulling jobs from a bounded queue.
+ * @description add() blocks while the queue is full, which provides
+ * backpressure to the producer so memory held by pending jobs stays bounded.
+ * The first exception thrown by a job is captured and rethrown from wait().
+ */
+class ThreadPool {
+public:
+	ThreadPool() = delete;
+	ThreadPool(const ThreadPool&) = delete;
+	// @param threads is the worker count, 0 uses the hardware concurrency.
+	// @param max_queued is the number of jobs that can wait for a worker, 0 is twice the thread count.
+	ThreadPool(const size_t threads, const size_t max_queued = 0);
+	~ThreadPool();
+
+	size_t								size() const { return mThreads.size(); }
+
+	void								add(const std::function<void(void)>&);
+	// Block until every added job has finished. Throw the first job error, if any.
+	void								wait();
+
+	// Answer the number of hardware threads, never less than 1.
+	static size_t						hardwareThreads();
+
+private:
+	void								run();
+
+	std::mutex							mMutex;
+	std::condition_variable				mJobAdded,
+										mJobTaken,
+										mJobDone;
+	std::deque<std::function<void(void)>>
+										mJobs;
+	size_t								mMaxQueued = 0,
+										mActive = 0;
+	bool								mQuit = false;
+	std::exception_ptr					mError;
+	std::vector<std::thread>			mThreads;
+};
+
+} // namespace gif
+
+#endif
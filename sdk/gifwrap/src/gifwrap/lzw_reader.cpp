@@ -1,6 +1,6 @@
 #include "lzw_reader.h"
 
-#include <iostream>
+#include <algorithm>
 #include <stdexcept>
 
 namespace gif {
@@ -15,10 +15,16 @@ const uint32_t			FLUSH_BUFFER = 1 << MAX_WIDTH;
 /**
  * @class gif::LzwReader
  */
-void LzwReader::begin(	const uint8_t code_size,
-						const std::function<void(const std::vector<uint8_t>&)> &flush_fn) {
-	if (code_size < 2 || code_size > 8) {
-		throw std::runtime_error("Code size invalid");
+void LzwReader::begin(const uint8_t code_size, const FlushFn &flush_fn) {
+	switch (code_size) {
+		case 2: mDecodeFn = &LzwReader::decodeCodeSize<2>; break;
+		case 3: mDecodeFn = &LzwReader::decodeCodeSize<3>; break;
+		case 4: mDecodeFn = &LzwReader::decodeCodeSize<4>; break;
+		case 5: mDecodeFn = &LzwReader::decodeCodeSize<5>; break;
+		case 6: mDecodeFn = &LzwReader::decodeCodeSize<6>; break;
+		case 7: mDecodeFn = &LzwReader::decodeCodeSize<7>; break;
+		case 8: mDecodeFn = &LzwReader::decodeCodeSize<8>; break;
+		default: throw std::runtime_error("Code size invalid");
 	}
 
 	mFlushFn = flush_fn;
@@ -37,123 +43,135 @@ void LzwReader::begin(	const uint8_t code_size,
 	mOutput.resize(2 * (1<<MAX_WIDTH));
 }
 
-bool LzwReader::decode(CIter begin, CIter end) {
-	mO = 0;
-size_t	code_count = 0;
-	while (begin != end) {
+template <uint32_t CodeSize>
+bool LzwReader::decodeCodeSize(CIter begin, CIter end) {
+	const uint16_t		clear_code = static_cast<uint16_t>(1u << CodeSize),
+						end_code = clear_code + 1;
+	if (begin == end) return true;
+
+	// Work on locals so the loop state stays in registers, and write it back on the way out.
+	const uint8_t		*in = reinterpret_cast<const uint8_t*>(&*begin),
+						*in_end = in + (end - begin);
+	uint8_t*			output = mOutput.data();
+	uint8_t*			suffix = mSuffix.data();
+	uint16_t*			prefix = mPrefix.data();
+	const size_t		output_size = mOutput.size();
+	uint32_t			bits = mBits,
+						nbits = mNBits,
+						width = mWidth;
+	uint16_t			hi = mHiCode,
+						overflow = mOverflow,
+						last = mLast;
+	size_t				o = 0;
+	bool				complete = true,
+						ended = false;
+
+	while (in != in_end) {
 		// get next code
-		bool			error = true;
-		uint16_t		code = readCodeLsb(begin, end, error);
-++code_count;
-		if (error) {
-			flush();
-			return false;
+		while (nbits < width && in != in_end) {
+			bits |= static_cast<uint32_t>(*in++) << nbits;
+			nbits += 8;
+		}
+		if (nbits < width) {
+			complete = false;
+			break;
 		}
+		const uint16_t	code = static_cast<uint16_t>(bits & ((1u << width) - 1));
+		bits >>= width;
+		nbits -= width;
 
 		// handle literal
-		if (code < mClearCode) {
-			mOutput[mO++] = static_cast<uint8_t>(code);
-			if (mLast != DECODER_INVALID) {
+		if (code < clear_code) {
+			output[o++] = static_cast<uint8_t>(code);
+			if (last != DECODER_INVALID) {
 				// Save what the hi code expands to.
-				mSuffix[mHiCode] = static_cast<uint8_t>(code);
-				mPrefix[mHiCode] = mLast;
+				suffix[hi] = static_cast<uint8_t>(code);
+				prefix[hi] = last;
 			}
 
 		// handle clear
-		} else if (code == mClearCode) {
-			mWidth = 1 + mCodeSize;
-			mHiCode = mEndCode;
-			mOverflow = 1 << mWidth;
-			mLast = DECODER_INVALID;
+		} else if (code == clear_code) {
+			width = 1 + CodeSize;
+			hi = end_code;
+			overflow = static_cast<uint16_t>(1u << width);
+			last = DECODER_INVALID;
 			continue;
 
 		// handle end
-		} else if (code == mEndCode) {
-			flush();
-			return true;
-
-		} else if (code <= mHiCode) {
-			uint16_t c = code;
-			size_t	i = mOutput.size()-1;
-			if (code == mHiCode) {
+		} else if (code == end_code) {
+			ended = true;
+			break;
+
+		} else if (code <= hi) {
+			uint16_t	c = code;
+			size_t		i = output_size-1;
+			if (code == hi && last != DECODER_INVALID) {
 				// code == hi is a special case which expands to the last expansion
 				// followed by the head of the last expansion. To find the head, we walk
 				// the prefix chain until we find a literal code.
-				c = mLast;
-				while (c >= mClearCode) {
-					c = mPrefix[c];
+				c = last;
+				while (c >= clear_code) {
+					c = prefix[c];
 				}
-				mOutput[i] = static_cast<uint8_t>(c);
+				output[i] = static_cast<uint8_t>(c);
 				i--;
-				c = mLast;
+				c = last;
 			}
 			// Copy the suffix chain into output and then write that to w.
-			while (c >= mClearCode) {
-				mOutput[i] = mSuffix[c];
+			while (c >= clear_code) {
+				output[i] = suffix[c];
 				i--;
-				c = mPrefix[c];
-			}
-			mOutput[i] = static_cast<uint8_t>(c);
-			for (size_t k=i; k<mOutput.size(); ++k) {
-				mOutput[mO++] = mOutput[k];
+				c = prefix[c];
 			}
-			if (mLast != DECODER_INVALID) {
+			output[i] = static_cast<uint8_t>(c);
+			std::copy(output + i, output + output_size, output + o);
+			o += output_size - i;
+			if (last != DECODER_INVALID) {
 				// Save what the hi code expands to.
-				mSuffix[mHiCode] = static_cast<uint8_t>(c);
-				mPrefix[mHiCode] = mLast;
+				suffix[hi] = static_cast<uint8_t>(c);
+				prefix[hi] = last;
 			}
 
 		// handle error
 		} else {
+			mO = o;
 			flush();
 			throw std::runtime_error("LZW decompressor on invalid code");
-			return false;
 		}
 
-		mLast = code;
-		mHiCode = mHiCode + 1;
-		if (mHiCode >= mOverflow) {
-			if (mWidth == MAX_WIDTH) {
-				mLast = DECODER_INVALID;
+		last = code;
+		++hi;
+		if (hi >= overflow) {
+			if (width == MAX_WIDTH) {
+				last = DECODER_INVALID;
+				// Undo the increment so hi stays inside the tables (as Go does).
+				--hi;
 			} else {
-				++mWidth;
-				mOverflow <<= 1;
+				++width;
+				overflow <<= 1;
 			}
 		}
-		if (mO >= FLUSH_BUFFER) {
+		if (o >= FLUSH_BUFFER) {
+			mO = o;
 			flush();
+			o = 0;
 		}
 	}
 
+	mBits = bits;
+	mNBits = nbits;
+	mWidth = width;
+	mHiCode = hi;
+	mOverflow = overflow;
+	mLast = last;
+	mO = o;
 	flush();
-	return true;
-}
-
-uint16_t LzwReader::readCodeLsb(CIter &begin, CIter end, bool &error) {
-	error = true;
-
-	while (mNBits < mWidth) {
-		if (begin == end) return 0;
-		const uint8_t	b = reinterpret_cast<const unsigned char&>(*begin);
-		++begin;
-
-		mBits |= static_cast<uint32_t>(b) << mNBits;
-		mNBits += 8;
-	}
-
-	uint16_t			code = static_cast<uint16_t>(mBits & ((1<<mWidth) - 1));
-	mBits >>= mWidth;
-	mNBits -= mWidth;
-	error = false;
-	return code;
+	return ended || complete;
 }
 
 void LzwReader::flush() {
 	if (mFlushFn && mO > 0) {
-		mAnswer.clear();
-		mAnswer.reserve(mO);
-		mAnswer.insert(mAnswer.begin(), mOutput.begin(), mOutput.begin()+mO);
-		mFlushFn(mAnswer);
+		mFlushFn(mOutput.data(), mO);
 	}
 	mO = 0;
 }
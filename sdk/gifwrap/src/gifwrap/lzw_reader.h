@@ -3,7 +3,7 @@
 
 #include <cstdint>
 #include <functional>
-#include <vector>
+#include "gif_memory.h"
 
 namespace gif {
 
@@ -16,25 +16,31 @@ https://golang.org/src/image/gif/reader.go
  */
 class LzwReader {
 public:
-	using Container = std::vector<char>;
+	using Container = gif::Vector<char>;
 	using Iter = Container::iterator;
 	using CIter = Container::const_iterator;
 
-	LzwReader() { }
+	// Receives each run of decoded indexes. The data is only valid during the call.
+	using FlushFn = std::function<void(const uint8_t *data, const size_t size)>;
 
-	void						begin(	const uint8_t code_size,
-										const std::function<void(const std::vector<uint8_t>&)> &flush_fn);
+	LzwReader(gif::MemoryResource *r = nullptr) : mSuffix(r), mPrefix(r), mOutput(r) { }
+
+	void						begin(const uint8_t code_size, const FlushFn &flush_fn);
 	// Decode the sequence, periodically sending the current codes
 	// to the flush function assigned in begin().
-	// Answer false on error.
-	bool						decode(CIter begin, CIter end);
+	// Answer false if the sequence ends partway through a code, which
+	// is normal between sub-blocks; the next call picks it up.
+	bool						decode(CIter begin, CIter end) { return (this->*mDecodeFn)(begin, end); }
 
 private:
-	uint16_t					readCodeLsb(CIter &begin, CIter end, bool &error);
+	// The decode loop, with the clear and end codes fixed at compile time.
+	// begin() selects the instantiation for the block's code size.
+	template <uint32_t CodeSize>
+	bool						decodeCodeSize(CIter begin, CIter end);
 	void						flush();
 
-	std::function<void(const std::vector<uint8_t>&)>
-								mFlushFn;
+	FlushFn						mFlushFn;
+	bool						(LzwReader::*mDecodeFn)(CIter, CIter) = nullptr;
 	uint16_t					mClearCode = 0,
 								mEndCode = 0,
 								mHiCode = 0,
@@ -45,10 +51,9 @@ private:
 								mNBits = 0,
 								mBits = 0,
 								mO = 0;
-	std::vector<uint8_t>		mSuffix;
-	std::vector<uint16_t>		mPrefix;
-	std::vector<uint8_t>		mOutput;
-	std::vector<uint8_t>		mAnswer;
+	gif::Vector<uint8_t>		mSuffix;
+	gif::Vector<uint16_t>		mPrefix;
+	gif::Vector<uint8_t>		mOutput;
 };
 
 } // namespace gif
@@ -1,7 +1,7 @@
 #include "lzw_writer.h"
 
+#include <algorithm>
 #include <iostream>
-#include <unordered_map>
 
 namespace gif {
 
@@ -13,37 +13,52 @@ const uint32_t		INVALID_CODE = static_cast<uint32_t>((static_cast<uint64_t>(1)<<
 const uint32_t		TABLE_SIZE = 4 * (1<<12);
 const uint32_t		TABLE_MASK = TABLE_SIZE - 1;
 const uint32_t		INVALID_ENTRY = 0;
-
-inline uint32_t		safeTableValue(const uint32_t key, const std::unordered_map<uint32_t, uint32_t> &table) {
-	auto			found = table.find(key);
-	if (found == table.end()) return INVALID_ENTRY;
-	return found->second;
-}
-
+// Output is handed to the flush function in chunks of about this many bytes.
+const size_t		FLUSH_SIZE = 4096;
 }
 
 /**
  * @class gif::LzwWriter
  */
 void LzwWriter::begin(	const uint8_t code_size,
-						const std::function<void(const std::vector<uint8_t>&)> &flush_fn) {
+						const std::function<void(const gif::Vector<uint8_t>&)> &flush_fn) {
 	mFlushFn = flush_fn;
 	mWidth = 1 + static_cast<uint32_t>(code_size);
 	mCodeSize = code_size;
 	mHi = (1<<mCodeSize) + 1;
 	mOverflow = 1<<(mCodeSize+1);
 	mSavedCode = INVALID_CODE;
-	mTable.clear();
+	// Each image is a new stream, so nothing can carry over from the last one.
+	mBits = 0;
+	mNBits = 0;
+	mOutput.clear();
+	// A flat table, like Go's, instead of a node-based map: no allocation
+	// per entry and it draws from my memory resource.
+	mTable.assign(TABLE_SIZE, INVALID_ENTRY);
 
 	// Write initial clear code
 	writeCodeLsb(clearCode());
 }
 
-void LzwWriter::encode(const std::vector<uint8_t> &bm) {
+void LzwWriter::encode(const gif::Vector<uint8_t> &bm) {
 	if (bm.empty()) return;
+	encodeBytes(bm.data(), bm.data() + bm.size());
+	close();
+}
+
+void LzwWriter::encode(const gif::PalettedBitmapView &bm) {
+	if (bm.empty()) return;
+	for (int32_t y=0; y<bm.mHeight; ++y) {
+		encodeBytes(bm.row(y), bm.row(y) + bm.mWidth);
+	}
+	close();
+}
+
+void LzwWriter::encodeBytes(const uint8_t *begin, const uint8_t *end) {
+	if (begin == end) return;
 
 	uint32_t			code = mSavedCode;
-	auto				bm_it = bm.begin(), end_it = bm.end();
+	const uint8_t		*bm_it = begin, *end_it = end;
 	if (code == INVALID_CODE) {
 		// The first code is always a literal code
 		code = *bm_it;
@@ -57,14 +72,14 @@ void LzwWriter::encode(const std::vector<uint8_t> &bm) {
 		// and do not emit a code yet.
 		uint32_t		hash = (key>>12 ^ key) & TABLE_MASK;
 		{
-			uint32_t	h = hash, t = safeTableValue(hash, mTable);
+			uint32_t	h = hash, t = mTable[hash];
 			while (t != INVALID_ENTRY) {
 				if (key == t>>12) {
 					code = t&MAX_CODE;
 					goto endloop;
 				}
 				h = (h+1)&TABLE_MASK;
-				t = safeTableValue(h, mTable);
+				t = mTable[h];
 			}
 		}
 
@@ -85,7 +100,7 @@ void LzwWriter::encode(const std::vector<uint8_t> &bm) {
 
 		// Otherwise, insert key -> e.hi into the map that e.table represents.
 		while (true) {
-			if (safeTableValue(hash, mTable) == INVALID_ENTRY) {
+			if (mTable[hash] == INVALID_ENTRY) {
 				mTable[hash] = (key << 12) | mHi;
 				break;
 			}
@@ -96,7 +111,6 @@ endloop:
 		++bm_it;
 	}
 	mSavedCode = code;
-	close();
 }
 
 void LzwWriter::close() {
@@ -108,26 +122,27 @@ void LzwWriter::close() {
 	writeCodeLsb(eof);
 
 	// Write the final bits.
-	if (mNBits > 0 && mFlushFn) {
-		mOutput.clear();
+	if (mNBits > 0) {
 		mOutput.push_back(static_cast<uint8_t>(mBits));
-		mFlushFn(mOutput);
+		mBits = 0;
+		mNBits = 0;
 	}
+	if (mFlushFn && !mOutput.empty()) mFlushFn(mOutput);
+	mOutput.clear();
 }
 
 void LzwWriter::writeCodeLsb(const uint32_t code) {
 	mBits |= code << mNBits;
 	mNBits += mWidth;
 	while (mNBits >= 8) {
-		if (mFlushFn) {
-			mOutput.clear();
-			mOutput.push_back(static_cast<uint8_t>(mBits));
-			mFlushFn(mOutput);
-		}
-
+		mOutput.push_back(static_cast<uint8_t>(mBits));
 		mBits >>= 8;
 		mNBits -= 8;
 	}
+	if (mOutput.size() >= FLUSH_SIZE) {
+		if (mFlushFn) mFlushFn(mOutput);
+		mOutput.clear();
+	}
 }
 
 LzwWriter::IncError LzwWriter::incHi() {
@@ -143,7 +158,7 @@ LzwWriter::IncError LzwWriter::incHi() {
 		mWidth = mCodeSize + 1;
 		mHi = clear + 1;
 		mOverflow = clear << 1;
-		for (auto& kv : mTable) kv.second = INVALID_ENTRY;
+		std::fill(mTable.begin(), mTable.end(), INVALID_ENTRY);
 		return IncError::kOutOfCodes;
 	}
 	return IncError::kNone;
@@ -152,7 +167,7 @@ LzwWriter::IncError LzwWriter::incHi() {
 /**
  * @class gif::WriterBuffer
  */
-void WriterBuffer::write(const std::vector<uint8_t> &data) {
+void WriterBuffer::write(const gif::Vector<uint8_t> &data) {
 	// Append to my current data
 	if (!data.empty()) {
 		mBuffer.reserve(mBuffer.size() + data.size());
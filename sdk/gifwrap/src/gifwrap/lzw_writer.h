@@ -4,8 +4,8 @@
 #include <cstdint>
 #include <fstream>
 #include <functional>
-#include <vector>
-#include <unordered_map>
+#include "gif_bitmap.h"
+#include "gif_memory.h"
 
 namespace gif {
 
@@ -18,20 +18,25 @@ https://golang.org/src/image/gif/writer.go
  */
 class LzwWriter {
 public:
-	LzwWriter() { }
+	LzwWriter(gif::MemoryResource *r = nullptr) : mTable(r), mOutput(r) { }
 
 	void						begin(	const uint8_t code_size,
-										const std::function<void(const std::vector<uint8_t>&)> &flush_fn);
-	void						encode(const std::vector<uint8_t>&);
+										const std::function<void(const gif::Vector<uint8_t>&)> &flush_fn);
+	// Encode the whole input and close the stream.
+	void						encode(const gif::Vector<uint8_t>&);
+	// Encode the rows in order, as one stream.
+	void						encode(const gif::PalettedBitmapView&);
 
 private:
+	// Continue the stream with the bytes, without closing it.
+	void						encodeBytes(const uint8_t *begin, const uint8_t *end);
 	void						close();
 	enum class IncError			{ kNone, kOutOfCodes, kWriteFailed };
 	inline uint32_t				clearCode() const { return static_cast<uint32_t>(1) << mCodeSize; }
 	void						writeCodeLsb(const uint32_t code);
 	IncError					incHi();
 
-	std::function<void(const std::vector<uint8_t>&)>
+	std::function<void(const gif::Vector<uint8_t>&)>
 								mFlushFn;
 
 	uint32_t					mCodeSize = 0,
@@ -41,9 +46,8 @@ private:
 								mHi = 0,
 								mOverflow = 0,
 								mSavedCode = 0;
-	std::unordered_map<uint32_t, uint32_t>
-								mTable;
-	std::vector<uint8_t>		mOutput;
+	gif::Vector<uint32_t>		mTable;
+	gif::Vector<uint8_t>		mOutput;
 };
 
 /**
@@ -54,11 +58,11 @@ class WriterBuffer {
 public:
 	WriterBuffer() = delete;
 	WriterBuffer(const WriterBuffer&) = delete;
-	WriterBuffer(std::ostream &s) : mStream(s) { }
+	WriterBuffer(std::ostream &s, gif::MemoryResource *r = nullptr) : mStream(s), mBuffer(r) { }
 
 	// Clear my buffer without writing anything
 	void						clear() { mBuffer.clear(); }
-	void						write(const std::vector<uint8_t>&);
+	void						write(const gif::Vector<uint8_t>&);
 	// Force writing my current state, even if it's not large enough for a block,
 	// and write the block terminator.
 	void						terminate();
@@ -69,7 +73,7 @@ private:
 	void						writeBlock(const size_t size);
 
 	std::ostream&				mStream;
-	std::vector<uint8_t>		mBuffer;
+	gif::Vector<uint8_t>		mBuffer;
 	size_t						mBlockSize = 255;
 };
 
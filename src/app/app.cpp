@@ -112,7 +112,7 @@ void App::update() {
 	// Get current GIF list
 	auto		list = mThreadOutput.pop();
 	if (list) {
-		mGifView.setTextures(list->mGifList);
+		mGifView.setTextures(list->mAnimation);
 		if (list->mReplaceNavigation) {
 			if (list->mPaths.size() == 1) {
 				mFileNavigationView.setNavigation(std::make_shared<DirectoryNavigation>(list->mPaths.front()));
@@ -212,7 +212,9 @@ void App::gifThreadLoad(const StringVec &input, const bool replace_navigation) {
 	if (!input.empty()) {
 		auto			fn = input.front();
 		mStatusTransport.push_back(Status(Status::Duration::kStart, ++mThreadStatusId, "Loading " + get_filename(fn)));
-		gif::Reader(fn).read(output->mGifList);
+		TextureGifList	list;
+		gif::Reader(fn).read(list);
+		output->mAnimation = list.publish();
 		mStatusTransport.push_back(Status(Status::Duration::kEnd, mThreadStatusId, std::string()));
 	}
 	mThreadOutput.push(output);
@@ -51,7 +51,7 @@ private:
 
 	struct Output {
 		// Representing a single GIF
-		TextureGifList			mGifList;
+		TextureAnimationRef		mAnimation;
 		// The path(s) that were the input to this operation
 		StringVec				mPaths;
 		bool					mReplaceNavigation = false;
@@ -10,17 +10,25 @@ namespace cs {
  * @class cs::TextureGifList
  */
 TextureGifList::TextureGifList()
-		: base([this](const gif::Bitmap &bm)->ci::gl::TextureRef { return convert(bm); }) {
+		: base([this](const gif::BitmapView &bm)->ci::gl::TextureRef { return convert(bm); }) {
+	// Textures are shared refs, so repeated frames can all point to a single upload.
+	setDeduplicate(true);
+	// Tiled frames go up a band at a time, so they're never whole in memory.
+	setBandAlloc([this](ci::gl::TextureRef &t, const gif::BitmapView &band, const int32_t top, const int32_t frame_height) {
+		convertBand(t, band, top, frame_height);
+	});
 }
 
 void TextureGifList::readerFinished() {
+	base::readerFinished();
 	mSurface = ci::Surface8u();
+	std::vector<uint8_t>().swap(mBandPixels);
 }
 
-ci::gl::TextureRef TextureGifList::convert(const gif::Bitmap &bm) {
-	if (bm.mPixels.empty()) return nullptr;
+ci::gl::TextureRef TextureGifList::convert(const gif::BitmapView &bm) {
+	if (bm.empty()) return nullptr;
 	// Error condition, should never happen
-	if (bm.mPixels.size() != static_cast<size_t>(bm.mWidth*bm.mHeight)) throw std::runtime_error("Bitmap pixels do not match size");
+	if (bm.mStride < static_cast<size_t>(bm.mWidth)) throw std::runtime_error("Bitmap stride is smaller than its width");
 
 	// Reuse a surface
 	if (mSurface.getWidth() != bm.mWidth || mSurface.getHeight() != bm.mHeight) {
@@ -28,9 +36,10 @@ ci::gl::TextureRef TextureGifList::convert(const gif::Bitmap &bm) {
 	}
 
 	ci::Surface8u&		dest(mSurface);
-	auto				src(bm.mPixels.begin());
+	int32_t				y = 0;
 	auto				pix = dest.getIter();
 	while (pix.line()) {
+		const gif::ColorA8u*	src = bm.row(y++);
 		while (pix.pixel()) {
 			pix.r() = src->r;
 			pix.g() = src->g;
@@ -47,4 +56,28 @@ ci::gl::TextureRef TextureGifList::convert(const gif::Bitmap &bm) {
 	return ans;
 }
 
+void TextureGifList::convertBand(ci::gl::TextureRef &t, const gif::BitmapView &band, const int32_t top, const int32_t frame_height) {
+	if (band.empty()) return;
+	if (!t) {
+		ci::gl::Texture2d::Format	fmt;
+		fmt.loadTopDown(true);
+		t = ci::gl::Texture2d::create(band.mWidth, frame_height, fmt);
+	}
+
+	// Pack the rows as RGBA, opaque like convert()
+	mBandPixels.resize(static_cast<size_t>(band.mWidth) * static_cast<size_t>(band.mHeight) * 4);
+	uint8_t*			dst = mBandPixels.data();
+	for (int32_t y=0; y<band.mHeight; ++y) {
+		const gif::ColorA8u*	src = band.row(y);
+		for (int32_t x=0; x<band.mWidth; ++x, ++src) {
+			*dst++ = src->r;
+			*dst++ = src->g;
+			*dst++ = src->b;
+			*dst++ = 255;
+		}
+	}
+	t->update(mBandPixels.data(), GL_RGBA, GL_UNSIGNED_BYTE, 0, band.mWidth, band.mHeight, ci::ivec2(0, top));
+	glFlush();
+}
+
 } // namespace cs
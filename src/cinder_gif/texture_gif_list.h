@@ -1,10 +1,13 @@
 #ifndef APP_CINDERGIF_TEXTUREGIFLIST_H_
 #define APP_CINDERGIF_TEXTUREGIFLIST_H_
 
+#include <vector>
 #include <cinder/gl/Texture.h>
 #include <gifwrap/gif_list.h>
 
 namespace cs {
+using TextureAnimation = gif::Animation<ci::gl::TextureRef>;
+using TextureAnimationRef = gif::AnimationRef<ci::gl::TextureRef>;
 
 /**
  * @class cs::TextureGifList
@@ -18,10 +21,14 @@ public:
 	void				readerFinished() override;
 
 private:
-	ci::gl::TextureRef	convert(const gif::Bitmap&);
+	ci::gl::TextureRef	convert(const gif::BitmapView&);
+	// Upload a band of a tiled frame into t, creating it on the first band.
+	void				convertBand(ci::gl::TextureRef &t, const gif::BitmapView &band, const int32_t top, const int32_t frame_height);
 
 	using base = gif::List<ci::gl::TextureRef>;
 	ci::Surface8u		mSurface;
+	std::vector<uint8_t>
+						mBandPixels;
 };
 
 } // namespace cs
@@ -30,14 +30,14 @@ GifView::GifView(kt::Cns &cns)
 	if (!mBatch) throw std::runtime_error("Background vbo can't create batch");
 }
 
-void GifView::setTextures(const TextureGifList &t) {
+void GifView::setTextures(const TextureAnimationRef &t) {
 	mTextures = t;
 	mTextureIndex = 0;
 	mNextTime = findFrameRate();
 	mTimer.start();
 
 	// Update size
-	auto*			frame = mTextures.getFrame(0);
+	auto*			frame = (mTextures ? mTextures->getFrame(0) : nullptr);
 	if (frame && frame->mBitmap) {
 		const glm::vec2		new_size(frame->mBitmap->getWidth(), frame->mBitmap->getHeight());
 		mBatch->replaceVboMesh(meshFor(new_size.x, new_size.y));
@@ -51,10 +51,10 @@ void GifView::setPlaybackSpeed(const float s) {
 }
 
 void GifView::onUpdate(const kt::UpdateParams&) {
-	if (!mTextures.empty()) {
+	if (mTextures && !mTextures->empty()) {
 		const double		elapsed = mTimer.elapsed();
 		if (elapsed >= mNextTime) {
-			if (++mTextureIndex >= mTextures.size()) {
+			if (++mTextureIndex >= mTextures->size()) {
 				mTextureIndex = 0;
 			}
 			restartTimer();
@@ -66,7 +66,7 @@ void GifView::onUpdate(const kt::UpdateParams&) {
 }
 
 void GifView::onDraw(const kt::view::DrawParams&) {
-	auto*			frame = mTextures.getFrame(mTextureIndex);
+	auto*			frame = (mTextures ? mTextures->getFrame(mTextureIndex) : nullptr);
 	if (frame && frame->mBitmap) {
 		ci::gl::color(1, 1, 1, 1);
 		ci::gl::ScopedTextureBind	ts(frame->mBitmap);
@@ -89,7 +89,7 @@ void GifView::restartTimer() {
 }
 
 double GifView::findFrameRate() const {
-	auto*			frame = mTextures.getFrame(mTextureIndex);
+	auto*			frame = (mTextures ? mTextures->getFrame(mTextureIndex) : nullptr);
 	if (frame && frame->mDelay > 0.00000001) return frame->mDelay;
 	return DEFAULT_FPS;
 }
@@ -18,7 +18,7 @@ public:
 	GifView(const GifView&) = delete;
 	GifView(kt::Cns&);
 
-	void					setTextures(const TextureGifList&);
+	void					setTextures(const TextureAnimationRef&);
 	size_t					getCurrentFrame() const { return mTextureIndex; }
 	// Controlled by the application -- set the current relative playback speed.
 	void					setPlaybackSpeed(const float = 1.0f);
@@ -34,7 +34,7 @@ private:
 	ci::gl::VboMeshRef		meshFor(const float width, const float h) const;
 
 	using base = kt::view::View;
-	TextureGifList			mTextures;
+	TextureAnimationRef		mTextures;
 	size_t					mTextureIndex = 0;
 	kt::time::Seconds		mTimer;
 	double					mNextTime;